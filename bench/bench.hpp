@@ -0,0 +1,26 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+
+namespace glrfw {
+
+namespace bench {
+
+// Average wall clock time of runs calls to func in milliseconds.
+template <typename F> double time_ms(F&& func, int runs)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        func();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count() /
+           runs;
+}
+
+} // end namespace bench
+
+} // end namespace glrfw
+
+#endif
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "mesh.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+// Usage: bvh_bench [file.stl] [rays]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    int num_rays = argc > 2 ? std::stoi(argv[2]) : 1000000;
+
+    glrfw::mesh mesh = glrfw::parse_stl(file, 0);
+    glm::vec3 lower = mesh.vertices[0];
+    glm::vec3 upper = lower;
+    for (const glm::vec3& vertex : mesh.vertices) {
+        lower = glm::min(lower, vertex);
+        upper = glm::max(upper, vertex);
+    }
+
+    glrfw::bvh tree;
+    double serial = time_ms([&]() { tree = glrfw::bvh(mesh, 1); }, 3);
+    double parallel = time_ms([&]() { tree = glrfw::bvh(mesh, 0); }, 3);
+
+    // rays from a sphere around the mesh towards points inside its bounds
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::vec3 center = 0.5f * (lower + upper);
+    float radius = glm::length(upper - lower);
+    std::vector<glrfw::ray> rays;
+    rays.reserve(static_cast<std::size_t>(num_rays));
+    for (int i = 0; i < num_rays; ++i) {
+        glm::vec3 target = lower + (upper - lower) * glm::vec3(unit(random),
+                                                               unit(random),
+                                                               unit(random));
+        float z = 2.0f * unit(random) - 1.0f;
+        float angle = 6.2831853f * unit(random);
+        float ring = std::sqrt(1.0f - z * z);
+        glm::vec3 origin = center + radius * glm::vec3(ring * std::cos(angle),
+                                                       ring * std::sin(angle),
+                                                       z);
+        rays.push_back(glrfw::ray(origin, target - origin));
+    }
+
+    std::size_t hits = 0;
+    double closest = time_ms(
+        [&]() {
+            hits = 0;
+            for (const glrfw::ray& r : rays) {
+                hits += tree.closest_hit(r).triangle != -1;
+            }
+        },
+        1);
+    std::size_t occluded = 0;
+    double any = time_ms(
+        [&]() {
+            occluded = 0;
+            for (const glrfw::ray& r : rays) {
+                occluded += tree.any_hit(r);
+            }
+        },
+        1);
+
+    std::cout << file << ": " << mesh.triangles.size() << " triangles, "
+              << tree.num_nodes() << " nodes" << std::endl;
+    std::cout << "build:       " << serial << " ms on 1 thread, " << parallel
+              << " ms on all threads" << std::endl;
+    std::cout << "closest hit: " << num_rays / closest * 1e-3
+              << " Mrays/s, " << hits << " hits" << std::endl;
+    std::cout << "any hit:     " << num_rays / any * 1e-3 << " Mrays/s, "
+              << occluded << " hits" << std::endl;
+    return 0;
+}
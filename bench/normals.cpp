@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "bench.hpp"
+#include "mesh.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+// Usage: normals_bench [file.stl] [runs] [threads]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    int runs = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    glrfw::mesh mesh = glrfw::parse_stl(file);
+    std::cout << file << ": " << mesh.triangles.size() << " triangles, "
+              << mesh.vertices.size() << " vertices" << std::endl;
+
+    unsigned int threads =
+        argc > 3 ? static_cast<unsigned int>(std::stoi(argv[3]))
+                 : std::max(1u, std::thread::hardware_concurrency());
+    double serial = time_ms([&mesh]() { mesh.calculate_normals(1); }, runs);
+    double parallel = time_ms(
+        [&mesh, threads]() { mesh.calculate_normals(threads); }, runs);
+
+    // meshes below a few chunks of triangles stay on one thread
+    std::cout << "1 thread:     " << serial << " ms" << std::endl;
+    std::cout << threads << " threads:    " << parallel << " ms" << std::endl;
+    std::cout << "speedup:      " << serial / parallel << "x" << std::endl;
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <string>
+#include "bench.hpp"
+#include "mesh.hpp"
+#include "rasterizer.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+// Usage: rasterizer_bench [file.stl] [size]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    int size = argc > 2 ? std::stoi(argv[2]) : 2048;
+
+    glrfw::mesh mesh = glrfw::parse_stl(file, 0);
+    // the shadow pass of the viewer
+    glm::vec3 light_pos(88.30f, 176.2f, 147.85f);
+    glm::mat4 matrix =
+        glm::perspective(45.0f, 1.0f, 0.1f, 1000.0f) *
+        glm::lookAt(light_pos, glm::vec3(0, 0, 0), glm::vec3(0, -1, 0));
+
+    glrfw::depth_rasterizer raster(size, size);
+    raster.polygon_offset(5.5f, 100.0f);
+    double serial = time_ms(
+        [&]() {
+            raster.clear();
+            raster.draw(mesh, matrix, 1);
+        },
+        3);
+    double parallel = time_ms(
+        [&]() {
+            raster.clear();
+            raster.draw(mesh, matrix, 0);
+        },
+        3);
+    std::size_t covered = 0;
+    for (float depth : raster.depths()) {
+        covered += depth < 1.0f;
+    }
+
+    std::cout << file << ": " << mesh.triangles.size() << " triangles, "
+              << covered << " of " << size * size << " pixels covered"
+              << std::endl;
+    std::cout << "1 thread:     " << serial << " ms" << std::endl;
+    std::cout << "all threads:  " << parallel << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "bench.hpp"
+#include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+namespace {
+
+// The original loader, reading and welding one record at a time through an
+// ifstream. Kept as the baseline for the mapped and windowed loaders.
+glrfw::mesh parse_stl_records(const std::string& file)
+{
+    std::ifstream stl(file, std::ios::in | std::ios::binary);
+    glrfw::mesh mesh;
+    // skip header
+    stl.seekg(80, std::ifstream::beg);
+    uint32_t num_tri = 0;
+    stl.read(reinterpret_cast<char*>(&num_tri), sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_tri; i++) {
+        // skip face normals
+        stl.seekg(3 * sizeof(float), std::ifstream::cur);
+        glm::vec3 a, b, c;
+        stl.read(reinterpret_cast<char*>(&a), sizeof(a));
+        stl.read(reinterpret_cast<char*>(&b), sizeof(b));
+        stl.read(reinterpret_cast<char*>(&c), sizeof(c));
+        stl.seekg(sizeof(uint16_t), std::ifstream::cur);
+        mesh.add_triangle(a, b, c);
+    }
+    mesh.calculate_normals();
+    mesh.centralize();
+    return mesh;
+}
+
+} // end of anonymous namespace
+
+// Usage: stl_bench [file.stl] [runs]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    int runs = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    glrfw::mesh mesh = glrfw::parse_stl(file);
+    std::cout << file << ": " << mesh.triangles.size() << " triangles, "
+              << mesh.vertices.size() << " vertices" << std::endl;
+
+    double read = time_ms(
+        [&file]() {
+            glrfw::stream_stl(file, 4096,
+                              [](const glrfw::stl_triangle*, std::size_t) {});
+        },
+        runs);
+    double records = time_ms([&file]() { parse_stl_records(file); }, runs);
+    double stream = time_ms([&file]() { glrfw::parse_stl_stream(file); }, runs);
+    double mapped = time_ms([&file]() { glrfw::parse_stl(file); }, runs);
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    double parallel =
+        time_ms([&file, threads]() { glrfw::parse_stl(file, threads); }, runs);
+
+    std::cout << "stream_stl:       " << read << " ms" << std::endl;
+    std::cout << "per record:       " << records << " ms" << std::endl;
+    std::cout << "parse_stl_stream: " << stream << " ms" << std::endl;
+    std::cout << "parse_stl:        " << mapped << " ms" << std::endl;
+    std::cout << "speedup:          " << records / mapped
+              << "x over per record, " << stream / mapped
+              << "x over parse_stl_stream" << std::endl;
+    double sorted = time_ms(
+        [&file]() { glrfw::parse_stl(file, 1, glrfw::weld_mode::sort); },
+        runs);
+
+    std::string cache = file + ".cache";
+    glrfw::load_cached_stl(file, cache);
+    double cached =
+        time_ms([&file, &cache]() { glrfw::load_cached_stl(file, cache); },
+                runs);
+    std::remove(cache.c_str());
+
+    std::cout << "parse_stl(" << threads << "):     " << parallel << " ms"
+              << std::endl;
+    std::cout << "speedup:          " << mapped / parallel
+              << "x over parse_stl" << std::endl;
+    std::cout << "weld_mode::sort:  " << sorted << " ms" << std::endl;
+    std::cout << "load_cached_stl:  " << cached << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include <iostream>
+#include <string>
+#include "bench.hpp"
+#include "bvh.hpp"
+#include "mesh.hpp"
+#include "visibility.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+// Usage: visibility_bench [file.stl] [sensor x y z] [poses]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    // the light position of the viewer
+    glm::vec3 sensor(88.30f, 176.2f, 147.85f);
+    if (argc > 4) {
+        sensor = glm::vec3(std::stof(argv[2]), std::stof(argv[3]),
+                           std::stof(argv[4]));
+    }
+    int num_poses = argc > 5 ? std::stoi(argv[5]) : 360;
+
+    glrfw::mesh mesh = glrfw::parse_stl(file, 0);
+    mesh.reorder_vertices(glrfw::vertex_order::morton);
+    glrfw::bvh tree(mesh, 0);
+
+    std::size_t single_visible = 0;
+    double single = time_ms(
+        [&]() {
+            single_visible = 0;
+            for (const glm::vec3& vertex : mesh.vertices) {
+                glrfw::ray segment(sensor, vertex - sensor, 0.0f,
+                                   1.0f - glrfw::visibility_bias);
+                single_visible += !tree.any_hit(segment);
+            }
+        },
+        1);
+    std::vector<unsigned char> visible;
+    double packet = time_ms(
+        [&]() { visible = glrfw::vertex_visibility(tree, mesh, sensor); }, 1);
+    double threads = time_ms(
+        [&]() {
+            visible = glrfw::vertex_visibility(tree, mesh, sensor, 0);
+        },
+        1);
+    std::size_t num_visible = 0;
+    for (unsigned char v : visible) {
+        num_visible += v;
+    }
+
+    // the light circle of the viewer
+    std::vector<glm::vec3> sensors =
+        glrfw::sensor_circle(100.0f, sensor.y, num_poses);
+    glrfw::coverage sweep;
+    double sweep_time = time_ms(
+        [&]() { sweep = glrfw::sweep_coverage(tree, mesh, sensors, 0); }, 1);
+    std::size_t never_seen = 0;
+    for (int count : sweep.triangle_counts) {
+        never_seen += count == 0;
+    }
+
+    double num_rays = static_cast<double>(mesh.vertices.size());
+    std::cout << file << ": " << mesh.vertices.size() << " vertices, "
+              << num_visible << " visible (" << single_visible
+              << " with single rays)" << std::endl;
+    std::cout << "single rays:  " << num_rays / single * 1e-3 << " Mrays/s"
+              << std::endl;
+    std::cout << "packets:      " << num_rays / packet * 1e-3 << " Mrays/s"
+              << std::endl;
+    std::cout << "all threads:  " << num_rays / threads * 1e-3 << " Mrays/s"
+              << std::endl;
+    std::cout << "sweep:        " << num_poses << " poses in "
+              << sweep_time * 1e-3 << " s, " << never_seen << " of "
+              << mesh.triangles.size() << " triangles never visible"
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include "bench.hpp"
+#include "mesh.hpp"
+#include "vertex_table.hpp"
+#include "config.h"
+
+using glrfw::bench::time_ms;
+
+namespace {
+
+// The hash formerly used by mesh::indices.
+struct xor_hash {
+    size_t operator()(const glm::vec3& k) const
+    {
+        return std::hash<float>()(k.x) ^ std::hash<float>()(k.y) ^
+               std::hash<float>()(k.z);
+    }
+};
+
+} // end of anonymous namespace
+
+// Usage: weld_bench [file.stl] [runs]
+int main(int argc, char* argv[])
+{
+    std::string file = argc > 1
+                           ? std::string(argv[1])
+                           : glrfw::resource_path + std::string("mesh.stl");
+    int runs = argc > 2 ? std::stoi(argv[2]) : 10;
+
+    std::vector<glm::vec3> corners;
+    std::size_t num_tri = glrfw::stream_stl(
+        file, 4096, [&corners](const glrfw::stl_triangle* batch,
+                               std::size_t count) {
+            for (std::size_t i = 0; i < count; ++i) {
+                corners.push_back(batch[i].a);
+                corners.push_back(batch[i].b);
+                corners.push_back(batch[i].c);
+            }
+        });
+
+    std::size_t map_size = 0;
+    std::size_t collisions = 0;
+    double map = time_ms(
+        [&]() {
+            std::unordered_map<glm::vec3, int, xor_hash> indices;
+            for (const glm::vec3& corner : corners) {
+                indices.insert(
+                    std::make_pair(corner, static_cast<int>(indices.size())));
+            }
+            map_size = indices.size();
+            collisions = 0;
+            for (std::size_t i = 0; i < indices.bucket_count(); ++i) {
+                if (indices.bucket_size(i) > 1) {
+                    collisions += indices.bucket_size(i) - 1;
+                }
+            }
+        },
+        runs);
+
+    std::size_t table_size = 0;
+    double table = time_ms(
+        [&]() {
+            glrfw::vertex_table indices;
+            indices.reserve(num_tri / 2 + 1);
+            for (const glm::vec3& corner : corners) {
+                indices.insert(corner, static_cast<int>(indices.size()));
+            }
+            table_size = indices.size();
+        },
+        runs);
+
+    std::cout << file << ": " << num_tri << " triangles" << std::endl;
+    std::cout << "unordered_map: " << map << " ms, " << map_size
+              << " vertices, " << collisions << " bucket collisions"
+              << std::endl;
+    std::cout << "vertex_table:  " << table << " ms, " << table_size
+              << " vertices" << std::endl;
+    std::cout << "speedup:       " << map / table << "x" << std::endl;
+    return 0;
+}
@@ -0,0 +1,11 @@
+#version 330
+
+// object id of the draw call and triangle index plus one, 0 is background
+out uvec2 id;
+
+uniform int object_id;
+
+void main()
+{
+    id = uvec2(uint(object_id), uint(gl_PrimitiveID) + 1u);
+}
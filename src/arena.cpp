@@ -0,0 +1,73 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace glrfw {
+
+arena::arena(std::size_t block_size)
+    : blocks_(), block_size_(std::max<std::size_t>(block_size, 64)),
+      current_(nullptr), end_(nullptr), capacity_(0), used_(0)
+{
+}
+
+arena::~arena()
+{
+    release();
+}
+
+void* arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto align = [alignment](char* ptr) {
+        std::uintptr_t value = reinterpret_cast<std::uintptr_t>(ptr);
+        std::uintptr_t padding = (alignment - value % alignment) % alignment;
+        return ptr + padding;
+    };
+    char* ptr = current_ == nullptr ? nullptr : align(current_);
+    if (ptr == nullptr || static_cast<std::size_t>(end_ - ptr) < size) {
+        // oversized requests get a block of their own
+        std::size_t block = std::max(block_size_, size + alignment);
+        blocks_.reserve(blocks_.size() + 1);
+        char* memory = static_cast<char*>(::operator new(block));
+        blocks_.push_back(memory);
+        capacity_ += block;
+        current_ = memory;
+        end_ = memory + block;
+        ptr = align(current_);
+    }
+    used_ += size;
+    current_ = ptr + size;
+    return ptr;
+}
+
+void arena::deallocate(void* ptr, std::size_t size)
+{
+    char* memory = static_cast<char*>(ptr);
+    if (memory + size == current_) {
+        current_ = memory;
+        used_ -= size;
+    }
+}
+
+void arena::release()
+{
+    for (char* block : blocks_) {
+        ::operator delete(block);
+    }
+    blocks_.clear();
+    current_ = nullptr;
+    end_ = nullptr;
+    capacity_ = 0;
+    used_ = 0;
+}
+
+std::size_t arena::capacity() const
+{
+    return capacity_;
+}
+
+std::size_t arena::used() const
+{
+    return used_;
+}
+
+} // end namespace glrfw
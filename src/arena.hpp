@@ -0,0 +1,114 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace glrfw {
+
+// Monotonic memory arena. Allocations are carved out of large blocks and
+// only given back all at once by release() or the destructor, except that
+// the most recent allocation can be returned right away. Not thread safe.
+class arena {
+public:
+    explicit arena(std::size_t block_size = std::size_t(1) << 20);
+
+    arena(const arena&) = delete;
+
+    arena& operator=(const arena&) = delete;
+
+    ~arena();
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    // Returns ptr to the arena if it was the last allocation, otherwise its
+    // memory stays in use until release().
+    void deallocate(void* ptr, std::size_t size);
+
+    // Frees every block, invalidating all memory handed out.
+    void release();
+
+    // Bytes reserved from the heap for blocks.
+    std::size_t capacity() const;
+
+    // Bytes handed out since the last release().
+    std::size_t used() const;
+
+private:
+    std::vector<char*> blocks_;
+
+    std::size_t block_size_;
+
+    char* current_;
+
+    char* end_;
+
+    std::size_t capacity_;
+
+    std::size_t used_;
+};
+
+// Standard allocator drawing from an arena, or from the heap if the arena
+// is null.
+template <typename T> class arena_allocator {
+public:
+    typedef T value_type;
+
+    arena_allocator(arena* source = nullptr) : source_(source)
+    {
+    }
+
+    template <typename U>
+    arena_allocator(const arena_allocator<U>& other)
+        : source_(other.source())
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        if (source_ == nullptr) {
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+        return static_cast<T*>(
+            source_->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t count)
+    {
+        if (source_ == nullptr) {
+            ::operator delete(ptr);
+        }
+        else {
+            source_->deallocate(ptr, count * sizeof(T));
+        }
+    }
+
+    arena* source() const
+    {
+        return source_;
+    }
+
+private:
+    arena* source_;
+};
+
+template <typename T, typename U>
+bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.source() == b.source();
+}
+
+template <typename T, typename U>
+bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b)
+{
+    return a.source() != b.source();
+}
+
+// Temporary buffer living in an arena.
+template <typename T>
+using scratch_vector = std::vector<T, arena_allocator<T>>;
+
+} // end namespace glrfw
+
+#endif
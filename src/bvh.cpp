@@ -0,0 +1,696 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GLRFW_USE_SSE
+#endif
+
+namespace glrfw {
+
+namespace {
+
+const int num_bins = 16;
+
+// Nodes with at least this many triangles build their left child on a
+// thread of its own, while the parallel depth lasts.
+const std::size_t min_parallel_size = 4096;
+
+// Deeper nodes are split at the median, which bounds the traversal stack.
+const int max_sah_depth = 64;
+
+const int stack_size = 128;
+
+struct box {
+    box()
+        : lower(std::numeric_limits<float>::infinity()),
+          upper(-std::numeric_limits<float>::infinity())
+    {
+    }
+
+    void grow(const glm::vec3& point)
+    {
+        lower = glm::min(lower, point);
+        upper = glm::max(upper, point);
+    }
+
+    void grow(const box& other)
+    {
+        lower = glm::min(lower, other.lower);
+        upper = glm::max(upper, other.upper);
+    }
+
+    float half_area() const
+    {
+        glm::vec3 extent = glm::max(upper - lower, glm::vec3(0.0f));
+        return extent.x * extent.y + extent.y * extent.z +
+               extent.z * extent.x;
+    }
+
+    glm::vec3 lower;
+
+    glm::vec3 upper;
+};
+
+// Reciprocal of a ray direction. Components too small to invert become
+// the largest float instead of infinity, so the slab tests never compute
+// 0 * inf for rays lying in the plane of a box face.
+glm::vec3 inverse_direction(const glm::vec3& direction)
+{
+    glm::vec3 inv_dir;
+    for (int axis = 0; axis < 3; ++axis) {
+        inv_dir[axis] =
+            std::abs(direction[axis]) > std::numeric_limits<float>::min()
+                ? 1.0f / direction[axis]
+                : std::copysign(std::numeric_limits<float>::max(),
+                                direction[axis]);
+    }
+    return inv_dir;
+}
+
+// Distance at which the ray enters the box, infinity if it misses.
+float enter_box(const glm::vec3& lower, const glm::vec3& upper,
+                const glm::vec3& origin, const glm::vec3& inv_dir,
+                float t_min, float t_max)
+{
+    float enter = t_min;
+    float leave = t_max;
+    for (int axis = 0; axis < 3; ++axis) {
+        float t0 = (lower[axis] - origin[axis]) * inv_dir[axis];
+        float t1 = (upper[axis] - origin[axis]) * inv_dir[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+    }
+    return enter <= leave ? enter : std::numeric_limits<float>::infinity();
+}
+
+#ifdef GLRFW_USE_SSE
+
+// Four rays in soa layout, lanes without a ray are never active.
+struct packet {
+    __m128 origin[3];
+
+    __m128 direction[3];
+
+    __m128 inv_dir[3];
+
+    __m128 t_min;
+
+    __m128 t_max;
+};
+
+packet make_packet(const ray* rays, int count)
+{
+    alignas(16) float values[11][4];
+    for (int lane = 0; lane < 4; ++lane) {
+        // unused lanes repeat the first ray to keep the arithmetic finite
+        const ray& r = rays[lane < count ? lane : 0];
+        glm::vec3 inv_dir = inverse_direction(r.direction);
+        for (int axis = 0; axis < 3; ++axis) {
+            values[axis][lane] = r.origin[axis];
+            values[3 + axis][lane] = r.direction[axis];
+            values[6 + axis][lane] = inv_dir[axis];
+        }
+        values[9][lane] = r.t_min;
+        values[10][lane] = r.t_max;
+    }
+    packet p;
+    for (int axis = 0; axis < 3; ++axis) {
+        p.origin[axis] = _mm_load_ps(values[axis]);
+        p.direction[axis] = _mm_load_ps(values[3 + axis]);
+        p.inv_dir[axis] = _mm_load_ps(values[6 + axis]);
+    }
+    p.t_min = _mm_load_ps(values[9]);
+    p.t_max = _mm_load_ps(values[10]);
+    return p;
+}
+
+// Lanes whose ray enters the box.
+__m128 enter_box(const glm::vec3& lower, const glm::vec3& upper,
+                 const packet& p)
+{
+    __m128 enter = p.t_min;
+    __m128 leave = p.t_max;
+    for (int axis = 0; axis < 3; ++axis) {
+        __m128 t0 = _mm_mul_ps(
+            _mm_sub_ps(_mm_set1_ps(lower[axis]), p.origin[axis]),
+            p.inv_dir[axis]);
+        __m128 t1 = _mm_mul_ps(
+            _mm_sub_ps(_mm_set1_ps(upper[axis]), p.origin[axis]),
+            p.inv_dir[axis]);
+        enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+        leave = _mm_min_ps(leave, _mm_max_ps(t0, t1));
+    }
+    return _mm_cmple_ps(enter, leave);
+}
+
+__m128 dot(const __m128* a, const __m128* b)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]),
+                                 _mm_mul_ps(a[1], b[1])),
+                      _mm_mul_ps(a[2], b[2]));
+}
+
+void cross(const __m128* a, const __m128* b, __m128* out)
+{
+    out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(b[1], a[2]));
+    out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(b[2], a[0]));
+    out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(b[0], a[1]));
+}
+
+// Lanes whose ray hits the triangle, with the same operations in the same
+// order as the scalar test so both agree exactly.
+__m128 intersect(const glm::vec3* corner, const packet& p)
+{
+    __m128 e1[3];
+    __m128 e2[3];
+    __m128 s[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        e1[axis] = _mm_set1_ps(corner[1][axis] - corner[0][axis]);
+        e2[axis] = _mm_set1_ps(corner[2][axis] - corner[0][axis]);
+        s[axis] = _mm_sub_ps(p.origin[axis], _mm_set1_ps(corner[0][axis]));
+    }
+    __m128 pv[3];
+    cross(p.direction, e2, pv);
+    __m128 det = dot(e1, pv);
+    __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    __m128 u = _mm_mul_ps(dot(s, pv), inv);
+    __m128 q[3];
+    cross(s, e1, q);
+    __m128 v = _mm_mul_ps(dot(p.direction, q), inv);
+    __m128 t = _mm_mul_ps(dot(e2, q), inv);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 mask = _mm_cmpgt_ps(abs_det, zero);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(u, one));
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, p.t_min));
+    return _mm_and_ps(mask, _mm_cmplt_ps(t, p.t_max));
+}
+
+#endif
+
+} // end of anonymous namespace
+
+const int bvh::max_leaf_size;
+
+const int bvh::packet_size;
+
+// Builds the tree into a sparse array in which every subtree of n
+// triangles owns a fixed range of 2n - 1 slots, so threads never compete
+// for nodes and the layout does not depend on scheduling. compact()
+// removes the gaps afterwards.
+class bvh::builder {
+public:
+    builder(const glm::vec3* vertices, const glm::ivec3* triangles,
+            std::size_t num_tri)
+        : boxes_(num_tri), centroids_(num_tri), order_(num_tri),
+          nodes_(num_tri == 0 ? 0 : 2 * num_tri - 1)
+    {
+        for (std::size_t i = 0; i < num_tri; ++i) {
+            for (int k = 0; k < 3; ++k) {
+                boxes_[i].grow(vertices[static_cast<std::size_t>(
+                    triangles[i][k])]);
+            }
+            centroids_[i] = 0.5f * (boxes_[i].lower + boxes_[i].upper);
+            order_[i] = static_cast<int>(i);
+        }
+    }
+
+    void build(unsigned int num_threads)
+    {
+        if (order_.empty()) {
+            return;
+        }
+        int parallel_depth = 0;
+        while ((1u << parallel_depth) < num_threads) {
+            ++parallel_depth;
+        }
+        build(0, 0, static_cast<int>(order_.size()), 1, 0, parallel_depth);
+    }
+
+    // Copies the used nodes in depth first order with adjacent children.
+    std::vector<node> compact() const
+    {
+        std::vector<node> out;
+        if (nodes_.empty()) {
+            return out;
+        }
+        out.reserve(nodes_.size());
+        out.push_back(nodes_[0]);
+        // pairs of sparse and compact index still to be expanded
+        std::vector<std::pair<int, int>> stack(1, std::make_pair(0, 0));
+        while (!stack.empty()) {
+            std::pair<int, int> entry = stack.back();
+            stack.pop_back();
+            const node& sparse = nodes_[static_cast<std::size_t>(entry.first)];
+            if (sparse.count != 0) {
+                continue;
+            }
+            int left = static_cast<int>(out.size());
+            out[static_cast<std::size_t>(entry.second)].start = left;
+            out.push_back(nodes_[static_cast<std::size_t>(sparse.start)]);
+            out.push_back(nodes_[static_cast<std::size_t>(sparse.start + 1)]);
+            stack.push_back(std::make_pair(sparse.start + 1, left + 1));
+            stack.push_back(std::make_pair(sparse.start, left));
+        }
+        // leaves hold several triangles, so most sparse slots went unused
+        out.shrink_to_fit();
+        return out;
+    }
+
+    const std::vector<int>& order() const
+    {
+        return order_;
+    }
+
+private:
+    // Builds node index over order_[first, last), children go to the
+    // slots from free onwards.
+    void build(int index, int first, int last, int free, int depth,
+               int parallel_depth)
+    {
+        node& current = nodes_[static_cast<std::size_t>(index)];
+        box bounds;
+        box centers;
+        for (int i = first; i < last; ++i) {
+            std::size_t tri = static_cast<std::size_t>(order_[
+                static_cast<std::size_t>(i)]);
+            bounds.grow(boxes_[tri]);
+            centers.grow(centroids_[tri]);
+        }
+        current.lower = bounds.lower;
+        current.upper = bounds.upper;
+        int count = last - first;
+
+        int mid = split(first, last, bounds, centers, depth);
+        if (mid == first) {
+            current.start = first;
+            current.count = count;
+            return;
+        }
+
+        // left subtree owns 2 * (mid - first) - 1 slots after the children
+        int left = free;
+        int left_free = free + 2;
+        int right_free = left_free + 2 * (mid - first) - 2;
+        current.start = left;
+        current.count = 0;
+        if (parallel_depth > 0 &&
+            static_cast<std::size_t>(count) >= min_parallel_size) {
+            std::thread worker([=]() {
+                build(left, first, mid, left_free, depth + 1,
+                      parallel_depth - 1);
+            });
+            build(left + 1, mid, last, right_free, depth + 1,
+                  parallel_depth - 1);
+            worker.join();
+        }
+        else {
+            build(left, first, mid, left_free, depth + 1, 0);
+            build(left + 1, mid, last, right_free, depth + 1, 0);
+        }
+    }
+
+    // Partitions order_[first, last) and returns the start of the right
+    // half, or first if the node should be a leaf.
+    int split(int first, int last, const box& bounds, const box& centers,
+              int depth)
+    {
+        int count = last - first;
+        glm::vec3 extent = centers.upper - centers.lower;
+        int axis = extent.x >= extent.y && extent.x >= extent.z
+                       ? 0
+                       : (extent.y >= extent.z ? 1 : 2);
+        if (count <= 1 || !(extent[axis] > 0.0f)) {
+            return count <= max_leaf_size ? first : median(first, last, axis);
+        }
+        if (depth >= max_sah_depth) {
+            return median(first, last, axis);
+        }
+
+        // cost of the best split on each axis, in units of a triangle test
+        float best_cost = std::numeric_limits<float>::infinity();
+        int best_axis = -1;
+        int best_bin = 0;
+        for (int dim = 0; dim < 3; ++dim) {
+            if (!(extent[dim] > 0.0f)) {
+                continue;
+            }
+            box bins[num_bins];
+            int counts[num_bins] = {};
+            float scale = num_bins / extent[dim];
+            for (int i = first; i < last; ++i) {
+                std::size_t tri = static_cast<std::size_t>(
+                    order_[static_cast<std::size_t>(i)]);
+                int bin = bin_of(centroids_[tri][dim], centers.lower[dim],
+                                 scale);
+                bins[bin].grow(boxes_[tri]);
+                ++counts[bin];
+            }
+            // areas and counts to the right of every bin boundary
+            float right_area[num_bins];
+            int right_count[num_bins];
+            box right;
+            int sum = 0;
+            for (int bin = num_bins - 1; bin > 0; --bin) {
+                right.grow(bins[bin]);
+                sum += counts[bin];
+                right_area[bin] = right.half_area();
+                right_count[bin] = sum;
+            }
+            box left;
+            sum = 0;
+            for (int bin = 1; bin < num_bins; ++bin) {
+                left.grow(bins[bin - 1]);
+                sum += counts[bin - 1];
+                if (sum == 0 || right_count[bin] == 0) {
+                    continue;
+                }
+                float cost = left.half_area() * static_cast<float>(sum) +
+                             right_area[bin] *
+                                 static_cast<float>(right_count[bin]);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = dim;
+                    best_bin = bin;
+                }
+            }
+        }
+        float leaf_cost = static_cast<float>(count);
+        float split_cost = 1.0f + best_cost / bounds.half_area();
+        if (best_axis == -1 ||
+            (count <= max_leaf_size && !(split_cost < leaf_cost))) {
+            return count <= max_leaf_size ? first : median(first, last, axis);
+        }
+
+        float lower = centers.lower[best_axis];
+        float scale = num_bins / extent[best_axis];
+        auto begin = order_.begin() + first;
+        auto mid = std::partition(begin, order_.begin() + last,
+                                  [&](int tri) {
+                                      return bin_of(centroids_[static_cast<
+                                                        std::size_t>(tri)]
+                                                               [best_axis],
+                                                    lower, scale) < best_bin;
+                                  });
+        return first + static_cast<int>(mid - begin);
+    }
+
+    int median(int first, int last, int axis)
+    {
+        int mid = first + (last - first) / 2;
+        std::nth_element(order_.begin() + first, order_.begin() + mid,
+                         order_.begin() + last, [&](int a, int b) {
+                             float ca = centroids_[static_cast<std::size_t>(
+                                 a)][axis];
+                             float cb = centroids_[static_cast<std::size_t>(
+                                 b)][axis];
+                             return ca < cb || (!(cb < ca) && a < b);
+                         });
+        return mid;
+    }
+
+    static int bin_of(float value, float lower, float scale)
+    {
+        int bin = static_cast<int>((value - lower) * scale);
+        return std::min(std::max(bin, 0), num_bins - 1);
+    }
+
+    std::vector<box> boxes_;
+
+    std::vector<glm::vec3> centroids_;
+
+    std::vector<int> order_;
+
+    std::vector<node> nodes_;
+};
+
+bvh::bvh() : nodes_(), corners_(), ids_()
+{
+}
+
+bvh::bvh(const glm::vec3* vertices, const glm::ivec3* triangles,
+         std::size_t num_tri, unsigned int num_threads)
+    : nodes_(), corners_(3 * num_tri), ids_()
+{
+    builder build(vertices, triangles, num_tri);
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    build.build(num_threads);
+    nodes_ = build.compact();
+    ids_ = build.order();
+    refit(vertices, triangles);
+}
+
+bvh::bvh(const std::vector<glm::vec3>& vertices,
+         const std::vector<glm::ivec3>& triangles, unsigned int num_threads)
+    : bvh(vertices.data(), triangles.data(), triangles.size(), num_threads)
+{
+}
+
+bvh::bvh(const mesh& mesh, unsigned int num_threads)
+    : bvh(mesh.vertices, mesh.triangles, num_threads)
+{
+}
+
+void bvh::refit(const glm::vec3* vertices, const glm::ivec3* triangles)
+{
+    for (std::size_t i = 0; i < ids_.size(); ++i) {
+        const glm::ivec3& tri = triangles[static_cast<std::size_t>(ids_[i])];
+        for (int k = 0; k < 3; ++k) {
+            corners_[3 * i + static_cast<std::size_t>(k)] =
+                vertices[static_cast<std::size_t>(tri[k])];
+        }
+    }
+    // children always come after their parent
+    for (std::size_t i = nodes_.size(); i-- > 0;) {
+        node& current = nodes_[i];
+        box bounds;
+        if (current.count != 0) {
+            std::size_t first = 3 * static_cast<std::size_t>(current.start);
+            std::size_t last =
+                first + 3 * static_cast<std::size_t>(current.count);
+            for (std::size_t j = first; j < last; ++j) {
+                bounds.grow(corners_[j]);
+            }
+        }
+        else {
+            for (int child = 0; child < 2; ++child) {
+                const node& sub =
+                    nodes_[static_cast<std::size_t>(current.start + child)];
+                bounds.grow(sub.lower);
+                bounds.grow(sub.upper);
+            }
+        }
+        current.lower = bounds.lower;
+        current.upper = bounds.upper;
+    }
+}
+
+void bvh::refit(const std::vector<glm::vec3>& vertices,
+                const std::vector<glm::ivec3>& triangles)
+{
+    refit(vertices.data(), triangles.data());
+}
+
+std::size_t bvh::num_nodes() const
+{
+    return nodes_.size();
+}
+
+std::size_t bvh::num_triangles() const
+{
+    return ids_.size();
+}
+
+std::size_t bvh::memory_usage() const
+{
+    return nodes_.capacity() * sizeof(node) +
+           corners_.capacity() * sizeof(glm::vec3) +
+           ids_.capacity() * sizeof(int);
+}
+
+bool bvh::intersect_leaf(const node& leaf, const ray& r, ray_hit& hit,
+                         bool any) const
+{
+    bool found = false;
+    for (int i = leaf.start; i < leaf.start + leaf.count; ++i) {
+        // Moeller and Trumbore
+        const glm::vec3* corner = &corners_[3 * static_cast<std::size_t>(i)];
+        glm::vec3 e1 = corner[1] - corner[0];
+        glm::vec3 e2 = corner[2] - corner[0];
+        glm::vec3 p = glm::cross(r.direction, e2);
+        float det = glm::dot(e1, p);
+        if (!(std::abs(det) > 0.0f)) {
+            continue;
+        }
+        float inv = 1.0f / det;
+        glm::vec3 s = r.origin - corner[0];
+        float u = glm::dot(s, p) * inv;
+        if (u < 0.0f || u > 1.0f) {
+            continue;
+        }
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(r.direction, q) * inv;
+        if (v < 0.0f || u + v > 1.0f) {
+            continue;
+        }
+        float t = glm::dot(e2, q) * inv;
+        if (!(t > r.t_min) || !(t < hit.t)) {
+            continue;
+        }
+        hit.triangle = ids_[static_cast<std::size_t>(i)];
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        found = true;
+        if (any) {
+            return true;
+        }
+    }
+    return found;
+}
+
+template <bool any> bool bvh::traverse(const ray& r, ray_hit& hit) const
+{
+    if (nodes_.empty()) {
+        return false;
+    }
+    glm::vec3 inv_dir = inverse_direction(r.direction);
+    hit.t = r.t_max;
+    bool found = false;
+    int stack[stack_size];
+    int top = 0;
+    if (enter_box(nodes_[0].lower, nodes_[0].upper, r.origin, inv_dir,
+                  r.t_min, hit.t) < std::numeric_limits<float>::infinity()) {
+        stack[top++] = 0;
+    }
+    while (top > 0) {
+        const node& current = nodes_[static_cast<std::size_t>(stack[--top])];
+        if (current.count != 0) {
+            if (intersect_leaf(current, r, hit, any)) {
+                found = true;
+                if (any) {
+                    return true;
+                }
+            }
+            continue;
+        }
+        // visit the nearer child first, skip children beyond the hit
+        int first = current.start;
+        int second = current.start + 1;
+        const node& a = nodes_[static_cast<std::size_t>(first)];
+        const node& b = nodes_[static_cast<std::size_t>(second)];
+        float t_first =
+            enter_box(a.lower, a.upper, r.origin, inv_dir, r.t_min, hit.t);
+        float t_second =
+            enter_box(b.lower, b.upper, r.origin, inv_dir, r.t_min, hit.t);
+        if (t_second < t_first) {
+            std::swap(first, second);
+            std::swap(t_first, t_second);
+        }
+        if (t_second < std::numeric_limits<float>::infinity()) {
+            stack[top++] = second;
+        }
+        if (t_first < std::numeric_limits<float>::infinity()) {
+            stack[top++] = first;
+        }
+    }
+    return found;
+}
+
+ray_hit bvh::closest_hit(const ray& r) const
+{
+    ray_hit hit;
+    if (!traverse<false>(r, hit)) {
+        hit = ray_hit();
+    }
+    return hit;
+}
+
+pick_result bvh::pick(const ray& r, const glm::vec3* vertices,
+                      const glm::ivec3* triangles) const
+{
+    pick_result result;
+    ray_hit hit = closest_hit(r);
+    if (hit.triangle == -1) {
+        return result;
+    }
+    const glm::ivec3& tri = triangles[static_cast<std::size_t>(hit.triangle)];
+    result.triangle = hit.triangle;
+    result.t = hit.t;
+    result.barycentric = glm::vec3(1.0f - hit.u - hit.v, hit.u, hit.v);
+    result.position =
+        result.barycentric.x * vertices[static_cast<std::size_t>(tri.x)] +
+        result.barycentric.y * vertices[static_cast<std::size_t>(tri.y)] +
+        result.barycentric.z * vertices[static_cast<std::size_t>(tri.z)];
+    return result;
+}
+
+bool bvh::any_hit(const ray& r) const
+{
+    ray_hit hit;
+    return traverse<true>(r, hit);
+}
+
+unsigned int bvh::any_hit_packet(const ray* rays, int count) const
+{
+    count = std::min(count, packet_size);
+    unsigned int occluded = 0;
+    if (nodes_.empty() || count <= 0) {
+        return occluded;
+    }
+#ifdef GLRFW_USE_SSE
+    packet p = make_packet(rays, count);
+    // rays that have not hit anything yet
+    int active = (1 << count) - 1;
+    int stack[stack_size];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const node& current = nodes_[static_cast<std::size_t>(stack[--top])];
+        int entered = active & _mm_movemask_ps(
+                                   enter_box(current.lower, current.upper, p));
+        if (entered == 0) {
+            continue;
+        }
+        if (current.count == 0) {
+            stack[top++] = current.start + 1;
+            stack[top++] = current.start;
+            continue;
+        }
+        int hit = 0;
+        for (int i = current.start; i < current.start + current.count; ++i) {
+            hit |= entered &
+                   _mm_movemask_ps(intersect(
+                       &corners_[3 * static_cast<std::size_t>(i)], p));
+            if (hit == entered) {
+                break;
+            }
+        }
+        occluded |= static_cast<unsigned int>(hit);
+        active &= ~hit;
+        if (active == 0) {
+            break;
+        }
+    }
+#else
+    for (int i = 0; i < count; ++i) {
+        if (any_hit(rays[i])) {
+            occluded |= 1u << i;
+        }
+    }
+#endif
+    return occluded;
+}
+
+} // end namespace glrfw
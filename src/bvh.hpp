@@ -0,0 +1,107 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <cstddef>
+#include <vector>
+#include "mesh.hpp"
+#include "ray.hpp"
+
+namespace glrfw {
+
+// Bounding volume hierarchy over the triangles of a mesh, stored as a flat
+// array of 32 byte nodes whose two children are adjacent. Nodes are split
+// with a binned surface area heuristic; the subtrees of large nodes are
+// built on separate threads.
+class bvh {
+public:
+    bvh();
+
+    // Builds the hierarchy over num_tri triangles with num_threads threads,
+    // 0 uses all hardware threads. The result does not depend on the number
+    // of threads. Only the corners are copied, in leaf order, so vertices
+    // and triangles may live in a mapped mesh_cache.
+    bvh(const glm::vec3* vertices, const glm::ivec3* triangles,
+        std::size_t num_tri, unsigned int num_threads = 1);
+
+    bvh(const std::vector<glm::vec3>& vertices,
+        const std::vector<glm::ivec3>& triangles,
+        unsigned int num_threads = 1);
+
+    explicit bvh(const mesh& mesh, unsigned int num_threads = 1);
+
+    ray_hit closest_hit(const ray& r) const;
+
+    // Whether the ray hits any triangle, stopping at the first one found.
+    bool any_hit(const ray& r) const;
+
+    // Traces count rays, at most packet_size, together and returns a mask
+    // with bit i set if rays[i] hits any triangle. The packet visits a node
+    // if any of its rays enters it, so it is fastest for rays with similar
+    // origins and directions. Uses sse where available and gives the same
+    // results as any_hit for every ray.
+    unsigned int any_hit_packet(const ray* rays, int count) const;
+
+    // Closest triangle hit by r, with the barycentrics applied to its
+    // corners in vertices. triangles must be the ones the hierarchy was
+    // built from.
+    pick_result pick(const ray& r, const glm::vec3* vertices,
+                     const glm::ivec3* triangles) const;
+
+    // Updates the bounds after vertices moved, keeping the tree topology.
+    // The triangles must be the ones the hierarchy was built from.
+    void refit(const glm::vec3* vertices, const glm::ivec3* triangles);
+
+    void refit(const std::vector<glm::vec3>& vertices,
+               const std::vector<glm::ivec3>& triangles);
+
+    std::size_t num_nodes() const;
+
+    std::size_t num_triangles() const;
+
+    // Bytes allocated by the nodes, the copied corners and triangle ids.
+    std::size_t memory_usage() const;
+
+    // Largest number of triangles in a leaf.
+    static const int max_leaf_size = 8;
+
+    // Number of rays traced together by any_hit_packet.
+    static const int packet_size = 4;
+
+private:
+    struct node {
+        node() : lower(), start(0), upper(), count(0)
+        {
+        }
+
+        glm::vec3 lower;
+
+        // first triangle of a leaf, left child of an inner node
+        int start;
+
+        glm::vec3 upper;
+
+        // number of triangles, 0 for inner nodes
+        int count;
+    };
+
+    class builder;
+
+    // Tests the triangles of a leaf, returns true on the first hit if
+    // any is set.
+    bool intersect_leaf(const node& leaf, const ray& r, ray_hit& hit,
+                        bool any) const;
+
+    template <bool any> bool traverse(const ray& r, ray_hit& hit) const;
+
+    std::vector<node> nodes_;
+
+    // corners of the triangles in leaf order, for intersection
+    std::vector<glm::vec3> corners_;
+
+    // index of every leaf triangle in the triangles it was built from
+    std::vector<int> ids_;
+};
+
+} // end namespace glrfw
+
+#endif
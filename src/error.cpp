@@ -16,6 +16,7 @@ const std::unordered_map<error_type, const char*> error_map =
 	(program_not_created,"program_not_created")
 	(no_shader_source,"no_shader_source")
 	(file_not_found,"file_not_found")
+	(invalid_file_format,"invalid_file_format")
 	(uniform_not_found,"uniform_not_found")
     (invalid_shader_type,"invalid_shader_type");
 
@@ -24,6 +24,7 @@ enum class error_type {
     program_not_created,
     no_shader_source,
     file_not_found,
+    invalid_file_format,
     uniform_not_found,
     invalid_shader_type
 };
@@ -0,0 +1,90 @@
+#include "half_edge.hpp"
+
+namespace glrfw {
+
+const int half_edges::boundary;
+
+const int half_edges::non_manifold;
+
+half_edges::half_edges()
+    : vertices_(), opposite_(), outgoing_(), non_manifold_()
+{
+}
+
+half_edges::half_edges(const std::vector<glm::ivec3>& triangles,
+                       std::size_t num_vertices)
+    : vertices_(3 * triangles.size()),
+      opposite_(3 * triangles.size(), boundary),
+      outgoing_(num_vertices, -1), non_manifold_()
+{
+    for (std::size_t i = 0; i < triangles.size(); ++i) {
+        for (int k = 0; k < 3; ++k) {
+            vertices_[3 * i + static_cast<std::size_t>(k)] = triangles[i][k];
+        }
+    }
+    int num_edges = static_cast<int>(vertices_.size());
+
+    // half-edges grouped by their start vertex, as in build_neighbors
+    std::vector<int> offsets(num_vertices + 1, 0);
+    for (int vertex : vertices_) {
+        ++offsets[static_cast<std::size_t>(vertex) + 1];
+    }
+    for (std::size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    std::vector<int> edges(vertices_.size());
+    std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+    for (int edge = 0; edge < num_edges; ++edge) {
+        edges[static_cast<std::size_t>(cursor[vertex(edge)]++)] = edge;
+    }
+
+    // pair every half-edge a -> b with the only b -> a, which requires
+    // a -> b to be unique as well
+    for (int edge = 0; edge < num_edges; ++edge) {
+        if (opposite_[static_cast<std::size_t>(edge)] != boundary) {
+            continue;
+        }
+        int from = vertex(edge);
+        int to = target(edge);
+        int same = 0;
+        for (int i = offsets[from]; i < offsets[from + 1]; ++i) {
+            same += target(edges[static_cast<std::size_t>(i)]) == to;
+        }
+        int reverse = 0;
+        int candidate = -1;
+        for (int i = offsets[to]; i < offsets[to + 1]; ++i) {
+            int other = edges[static_cast<std::size_t>(i)];
+            if (target(other) == from) {
+                ++reverse;
+                candidate = other;
+            }
+        }
+        if (same == 1 && reverse == 1) {
+            opposite_[static_cast<std::size_t>(edge)] = candidate;
+            opposite_[static_cast<std::size_t>(candidate)] = edge;
+        }
+        else if (same + reverse > 1) {
+            opposite_[static_cast<std::size_t>(edge)] = non_manifold;
+            non_manifold_.push_back(edge);
+        }
+    }
+
+    for (int edge = 0; edge < num_edges; ++edge) {
+        int& out = outgoing_[static_cast<std::size_t>(vertex(edge))];
+        if (out == -1 || (is_boundary(edge) && !is_boundary(out))) {
+            out = edge;
+        }
+    }
+}
+
+std::size_t half_edges::size() const
+{
+    return vertices_.size();
+}
+
+const std::vector<int>& half_edges::non_manifold_edges() const
+{
+    return non_manifold_;
+}
+
+} // end namespace glrfw
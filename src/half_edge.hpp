@@ -0,0 +1,100 @@
+#ifndef HALF_EDGE_HPP
+#define HALF_EDGE_HPP
+
+#include <cstddef>
+#include <vector>
+#include "error.hpp"
+
+namespace glrfw {
+
+// Index based half-edge structure of a triangle mesh. Half-edge 3 * t + k
+// runs from corner k to corner k + 1 of triangle t, so next, prev, face
+// and vertex are implicit; only the opposite half-edges and one outgoing
+// half-edge per vertex are stored.
+class half_edges {
+public:
+    half_edges();
+
+    // Builds the structure in time linear in the number of triangles for
+    // bounded vertex valence. Edges used by more than two triangles, or
+    // twice in the same direction, are non-manifold and get no opposite.
+    half_edges(const std::vector<glm::ivec3>& triangles,
+               std::size_t num_vertices);
+
+    // Number of half-edges, three per triangle.
+    std::size_t size() const;
+
+    int next(int edge) const
+    {
+        return edge % 3 == 2 ? edge - 2 : edge + 1;
+    }
+
+    int prev(int edge) const
+    {
+        return edge % 3 == 0 ? edge + 2 : edge - 1;
+    }
+
+    // Paired half-edge of the neighboring triangle, -1 on boundary and
+    // non-manifold edges.
+    int opposite(int edge) const
+    {
+        return opposite_[static_cast<std::size_t>(edge)] < 0
+                   ? -1
+                   : opposite_[static_cast<std::size_t>(edge)];
+    }
+
+    // Vertex the half-edge starts at.
+    int vertex(int edge) const
+    {
+        return vertices_[static_cast<std::size_t>(edge)];
+    }
+
+    // Vertex the half-edge points to.
+    int target(int edge) const
+    {
+        return vertex(next(edge));
+    }
+
+    int face(int edge) const
+    {
+        return edge / 3;
+    }
+
+    // A half-edge starting at vertex, -1 if no triangle uses it. Boundary
+    // half-edges are preferred, so stepping to opposite(prev(edge)) from
+    // there until -1 or the start is reached visits the whole one-ring.
+    int outgoing(int vertex) const
+    {
+        return outgoing_[static_cast<std::size_t>(vertex)];
+    }
+
+    bool is_boundary(int edge) const
+    {
+        return opposite_[static_cast<std::size_t>(edge)] == boundary;
+    }
+
+    bool is_non_manifold(int edge) const
+    {
+        return opposite_[static_cast<std::size_t>(edge)] == non_manifold;
+    }
+
+    // Half-edges lying on non-manifold edges.
+    const std::vector<int>& non_manifold_edges() const;
+
+private:
+    static const int boundary = -1;
+
+    static const int non_manifold = -2;
+
+    std::vector<int> vertices_;
+
+    std::vector<int> opposite_;
+
+    std::vector<int> outgoing_;
+
+    std::vector<int> non_manifold_;
+};
+
+} // end namespace glrfw
+
+#endif
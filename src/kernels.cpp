@@ -0,0 +1,274 @@
+#include "kernels.hpp"
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GLRFW_USE_SSE
+#endif
+
+namespace glrfw {
+
+namespace {
+
+#ifdef GLRFW_USE_SSE
+
+// Loads one component of the given corner of four triangles.
+__m128 gather(const glm::vec3* vertices, const glm::ivec3* tri, int corner,
+              int component)
+{
+    return _mm_setr_ps(vertices[tri[0][corner]][component],
+                       vertices[tri[1][corner]][component],
+                       vertices[tri[2][corner]][component],
+                       vertices[tri[3][corner]][component]);
+}
+
+// Loads one component of the given corner of four triangles from soa data.
+__m128 gather(const float* data, const glm::ivec3* tri, int corner)
+{
+    return _mm_setr_ps(data[tri[0][corner]], data[tri[1][corner]],
+                       data[tri[2][corner]], data[tri[3][corner]]);
+}
+
+float horizontal_sum(__m128 v)
+{
+    alignas(16) float out[4];
+    _mm_store_ps(out, v);
+    return (out[0] + out[1]) + (out[2] + out[3]);
+}
+
+#endif
+
+} // end of anonymous namespace
+
+void compute_face_normals(const glm::vec3* vertices,
+                          const glm::ivec3* triangles, std::size_t num_tri,
+                          glm::vec3* normals, float* areas)
+{
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= num_tri; i += 4) {
+        const glm::ivec3* tri = triangles + i;
+        __m128 ax = gather(vertices, tri, 0, 0);
+        __m128 ay = gather(vertices, tri, 0, 1);
+        __m128 az = gather(vertices, tri, 0, 2);
+        __m128 e1x = _mm_sub_ps(gather(vertices, tri, 1, 0), ax);
+        __m128 e1y = _mm_sub_ps(gather(vertices, tri, 1, 1), ay);
+        __m128 e1z = _mm_sub_ps(gather(vertices, tri, 1, 2), az);
+        __m128 e2x = _mm_sub_ps(gather(vertices, tri, 2, 0), ax);
+        __m128 e2y = _mm_sub_ps(gather(vertices, tri, 2, 1), ay);
+        __m128 e2z = _mm_sub_ps(gather(vertices, tri, 2, 2), az);
+
+        // same operation order as glm::cross and glm::normalize
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e2y, e1z));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e2z, e1x));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e2x, e1y));
+        __m128 length = _mm_sqrt_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                       _mm_mul_ps(nz, nz)));
+        __m128 inv = _mm_div_ps(one, length);
+
+        alignas(16) float out[12];
+        _mm_store_ps(out, _mm_mul_ps(nx, inv));
+        _mm_store_ps(out + 4, _mm_mul_ps(ny, inv));
+        _mm_store_ps(out + 8, _mm_mul_ps(nz, inv));
+        for (std::size_t j = 0; j < 4; ++j) {
+            normals[i + j] = glm::vec3(out[j], out[4 + j], out[8 + j]);
+        }
+        if (areas != nullptr) {
+            _mm_storeu_ps(areas + i, _mm_mul_ps(length, half));
+        }
+    }
+#endif
+    for (; i < num_tri; ++i) {
+        const glm::ivec3& tri = triangles[i];
+        const glm::vec3& a = vertices[tri.x];
+        glm::vec3 cross = glm::cross(vertices[tri.y] - a, vertices[tri.z] - a);
+        normals[i] = glm::normalize(cross);
+        if (areas != nullptr) {
+            areas[i] = 0.5f * glm::length(cross);
+        }
+    }
+}
+
+void compute_face_normals(const float* x, const float* y, const float* z,
+                          const glm::ivec3* triangles, std::size_t num_tri,
+                          float* nx, float* ny, float* nz, float* areas)
+{
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 4 <= num_tri; i += 4) {
+        const glm::ivec3* tri = triangles + i;
+        __m128 ax = gather(x, tri, 0);
+        __m128 ay = gather(y, tri, 0);
+        __m128 az = gather(z, tri, 0);
+        __m128 e1x = _mm_sub_ps(gather(x, tri, 1), ax);
+        __m128 e1y = _mm_sub_ps(gather(y, tri, 1), ay);
+        __m128 e1z = _mm_sub_ps(gather(z, tri, 1), az);
+        __m128 e2x = _mm_sub_ps(gather(x, tri, 2), ax);
+        __m128 e2y = _mm_sub_ps(gather(y, tri, 2), ay);
+        __m128 e2z = _mm_sub_ps(gather(z, tri, 2), az);
+
+        __m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e2y, e1z));
+        __m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e2z, e1x));
+        __m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e2x, e1y));
+        __m128 length = _mm_sqrt_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)),
+                       _mm_mul_ps(cz, cz)));
+        __m128 inv = _mm_div_ps(one, length);
+
+        _mm_storeu_ps(nx + i, _mm_mul_ps(cx, inv));
+        _mm_storeu_ps(ny + i, _mm_mul_ps(cy, inv));
+        _mm_storeu_ps(nz + i, _mm_mul_ps(cz, inv));
+        if (areas != nullptr) {
+            _mm_storeu_ps(areas + i, _mm_mul_ps(length, half));
+        }
+    }
+#endif
+    for (; i < num_tri; ++i) {
+        const glm::ivec3& tri = triangles[i];
+        glm::vec3 a(x[tri.x], y[tri.x], z[tri.x]);
+        glm::vec3 b(x[tri.y], y[tri.y], z[tri.y]);
+        glm::vec3 c(x[tri.z], y[tri.z], z[tri.z]);
+        glm::vec3 cross = glm::cross(b - a, c - a);
+        glm::vec3 normal = glm::normalize(cross);
+        nx[i] = normal.x;
+        ny[i] = normal.y;
+        nz[i] = normal.z;
+        if (areas != nullptr) {
+            areas[i] = 0.5f * glm::length(cross);
+        }
+    }
+}
+
+void normalize_vectors(float* x, float* y, float* z, std::size_t count)
+{
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 vx = _mm_loadu_ps(x + i);
+        __m128 vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+        __m128 length = _mm_sqrt_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+                       _mm_mul_ps(vz, vz)));
+        // keep zero vectors instead of producing nan
+        __m128 valid = _mm_cmpgt_ps(length, zero);
+        __m128 inv = _mm_and_ps(valid, _mm_div_ps(one, length));
+        __m128 keep = _mm_andnot_ps(valid, one);
+        __m128 scale = _mm_or_ps(inv, keep);
+        _mm_storeu_ps(x + i, _mm_mul_ps(vx, scale));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vy, scale));
+        _mm_storeu_ps(z + i, _mm_mul_ps(vz, scale));
+    }
+#endif
+    for (; i < count; ++i) {
+        glm::vec3 v(x[i], y[i], z[i]);
+        float length = glm::length(v);
+        if (length > 0.0f) {
+            v /= length;
+            x[i] = v.x;
+            y[i] = v.y;
+            z[i] = v.z;
+        }
+    }
+}
+
+glm::vec3 sum_vectors(const float* x, const float* y, const float* z,
+                      std::size_t count)
+{
+    glm::vec3 sum(0.0f);
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    __m128 sx = _mm_setzero_ps();
+    __m128 sy = _mm_setzero_ps();
+    __m128 sz = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        sx = _mm_add_ps(sx, _mm_loadu_ps(x + i));
+        sy = _mm_add_ps(sy, _mm_loadu_ps(y + i));
+        sz = _mm_add_ps(sz, _mm_loadu_ps(z + i));
+    }
+    sum = glm::vec3(horizontal_sum(sx), horizontal_sum(sy),
+                    horizontal_sum(sz));
+#endif
+    for (; i < count; ++i) {
+        sum += glm::vec3(x[i], y[i], z[i]);
+    }
+    return sum;
+}
+
+void translate_vectors(float* x, float* y, float* z, std::size_t count,
+                       const glm::vec3& offset)
+{
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    const __m128 ox = _mm_set1_ps(offset.x);
+    const __m128 oy = _mm_set1_ps(offset.y);
+    const __m128 oz = _mm_set1_ps(offset.z);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), ox));
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), oy));
+        _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), oz));
+    }
+#endif
+    for (; i < count; ++i) {
+        x[i] += offset.x;
+        y[i] += offset.y;
+        z[i] += offset.z;
+    }
+}
+
+std::pair<glm::vec3, glm::vec3> bounds_of(const float* x, const float* y,
+                                          const float* z, std::size_t count)
+{
+    if (count == 0) {
+        float inf = std::numeric_limits<float>::infinity();
+        return std::make_pair(glm::vec3(inf), glm::vec3(-inf));
+    }
+    glm::vec3 lower(x[0], y[0], z[0]);
+    glm::vec3 upper = lower;
+    std::size_t i = 0;
+#ifdef GLRFW_USE_SSE
+    if (count >= 4) {
+        __m128 min_x = _mm_loadu_ps(x), max_x = min_x;
+        __m128 min_y = _mm_loadu_ps(y), max_y = min_y;
+        __m128 min_z = _mm_loadu_ps(z), max_z = min_z;
+        for (i = 4; i + 4 <= count; i += 4) {
+            __m128 vx = _mm_loadu_ps(x + i);
+            __m128 vy = _mm_loadu_ps(y + i);
+            __m128 vz = _mm_loadu_ps(z + i);
+            min_x = _mm_min_ps(min_x, vx);
+            max_x = _mm_max_ps(max_x, vx);
+            min_y = _mm_min_ps(min_y, vy);
+            max_y = _mm_max_ps(max_y, vy);
+            min_z = _mm_min_ps(min_z, vz);
+            max_z = _mm_max_ps(max_z, vz);
+        }
+        alignas(16) float out[24];
+        _mm_store_ps(out, min_x);
+        _mm_store_ps(out + 4, min_y);
+        _mm_store_ps(out + 8, min_z);
+        _mm_store_ps(out + 12, max_x);
+        _mm_store_ps(out + 16, max_y);
+        _mm_store_ps(out + 20, max_z);
+        for (int j = 0; j < 4; ++j) {
+            lower = glm::min(lower, glm::vec3(out[j], out[4 + j], out[8 + j]));
+            upper = glm::max(upper,
+                             glm::vec3(out[12 + j], out[16 + j], out[20 + j]));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        glm::vec3 v(x[i], y[i], z[i]);
+        lower = glm::min(lower, v);
+        upper = glm::max(upper, v);
+    }
+    return std::make_pair(lower, upper);
+}
+
+} // end namespace glrfw
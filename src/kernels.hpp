@@ -0,0 +1,46 @@
+#ifndef KERNELS_HPP
+#define KERNELS_HPP
+
+#include <cstddef>
+#include <utility>
+#include "error.hpp"
+
+namespace glrfw {
+
+// Calculates the unit normals of num_tri triangles indexing into vertices,
+// and their areas if areas is not null. Four triangles are processed at a
+// time with sse where available, the remainder and other targets use the
+// scalar path. Both give the same results as glm::normalize(glm::cross()).
+void compute_face_normals(const glm::vec3* vertices,
+                          const glm::ivec3* triangles, std::size_t num_tri,
+                          glm::vec3* normals, float* areas = nullptr);
+
+// Structure of arrays variants operating on separate x, y and z arrays.
+// They are vectorized along the arrays, so no gathers or shuffles are
+// needed except for the triangle corners.
+
+// Same as above with vertices and normals in soa layout.
+void compute_face_normals(const float* x, const float* y, const float* z,
+                          const glm::ivec3* triangles, std::size_t num_tri,
+                          float* nx, float* ny, float* nz,
+                          float* areas = nullptr);
+
+// Normalizes count vectors in place, zero vectors are left untouched.
+void normalize_vectors(float* x, float* y, float* z, std::size_t count);
+
+// Sum of count vectors.
+glm::vec3 sum_vectors(const float* x, const float* y, const float* z,
+                      std::size_t count);
+
+// Adds offset to count vectors.
+void translate_vectors(float* x, float* y, float* z, std::size_t count,
+                       const glm::vec3& offset);
+
+// Componentwise minimum and maximum of count vectors. When count is 0 the
+// box is empty, lower is +infinity and upper -infinity like bvh's boxes.
+std::pair<glm::vec3, glm::vec3> bounds_of(const float* x, const float* y,
+                                          const float* z, std::size_t count);
+
+} // end namespace glrfw
+
+#endif
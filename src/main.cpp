@@ -1,9 +1,17 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include "bvh.hpp"
 #include "error.hpp"
 #include "mesh.hpp"
+#include "mesh_cache.hpp"
+#include "optimize.hpp"
+#include "rasterizer.hpp"
+#include "simplify.hpp"
 #include "config.h"
 #include "glutils.hpp"
 #include "shader.hpp"
@@ -47,6 +55,30 @@ std::vector<glm::vec3> sensor
         
 };
 
+// The jaw, the coarse level of detail the depth passes draw and the
+// hierarchy for picking, loaded together on a worker thread
+struct jaw_data {
+    jaw_data(glrfw::mesh_cache&& full, glrfw::mesh_cache&& lod)
+        : mesh(std::move(full)), shadow_lod(std::move(lod)),
+          pick_tree(mesh.vertices(), mesh.triangles(), mesh.num_triangles(),
+                    0)
+    {
+    }
+
+    glrfw::mesh_cache mesh;
+
+    glrfw::mesh_cache shadow_lod;
+
+    // built straight from the mapped cache so the jaw is not copied
+    glrfw::bvh pick_tree;
+};
+
+template <typename T>
+bool is_ready(const std::future<T>& future)
+{
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+}
 
 glm::vec3 getArcBall(const glm::vec2& pos, int width, int height)
 {
@@ -108,19 +140,70 @@ int main(int argc, char* argv[])
     std::cout << glrfw::glsl_version() << std::endl;
     std::cout << glrfw::gl_version_string() << std::endl;
 
-    // load mesh
-    glrfw::mesh mesh =
-        glrfw::parse_stl(glrfw::resource_path + std::string("kiefer.stl"));
+    // load mesh on a worker thread, the welded cache is reused as long as
+    // the stl is unchanged. Copies of a vertex that differ by the scanner's
+    // round off are merged, the tolerance is far below the scan resolution.
+    // When a cache has to be rebuilt, the parsed jaw is clustered into a
+    // coarse preview that is drawn until the cached meshes are ready.
+    const float weld_epsilon = 1e-4f;
+    std::promise<glrfw::mesh> preview_promise;
+    std::future<glrfw::mesh> preview = preview_promise.get_future();
+    std::future<std::unique_ptr<jaw_data>> loading = std::async(
+        std::launch::async, [&preview_promise, weld_epsilon]() {
+            bool previewed = false;
+            auto parsed = [&preview_promise,
+                           &previewed](const glrfw::mesh& jaw) {
+                if (!previewed) {
+                    previewed = true;
+                    preview_promise.set_value(
+                        glrfw::cluster_vertices(jaw, 128));
+                }
+            };
+            std::string stl = glrfw::resource_path + std::string("kiefer.stl");
+            glrfw::mesh_cache full = glrfw::load_cached_stl(
+                stl, glrfw::resource_path + std::string("kiefer.cache"), 1.0f,
+                weld_epsilon, parsed);
+            // the depth passes only need the silhouette, they draw a coarse
+            // level of detail while shading uses the full mesh
+            glrfw::mesh_cache lod = glrfw::load_cached_stl(
+                stl, glrfw::resource_path + std::string("kiefer_lod10.cache"),
+                0.1f, weld_epsilon, parsed);
+            return std::unique_ptr<jaw_data>(
+                new jaw_data(std::move(full), std::move(lod)));
+        });
+
+    // wait for the preview, or for the jaw itself if the caches are valid
+    std::unique_ptr<jaw_data> jaw;
+    glrfw::mesh preview_mesh;
+    while (loading.wait_for(std::chrono::milliseconds(1)) !=
+               std::future_status::ready &&
+           !is_ready(preview)) {
+    }
+    if (is_ready(loading)) {
+        jaw = loading.get();
+    }
+    else {
+        preview_mesh = preview.get();
+    }
 
+    std::vector<glm::vec3> ground_corners
+    {
+        {-100.0f,100.0f,-20.0f},
+        {-100.0f,-100.0f,-20.0f},
+        {100.0f,-100.0f,-20.0f},
+        {100.0f,-100.0f,-20.0f},
+        {100.0f,100.0f,-20.0f},
+        {-100.0f,100.0f,-20.0f}
+    };
     glrfw::mesh ground_mesh;
-    ground_mesh.add_triangle(glm::vec3(-100.0f,100.0f,-20.0f),
-                             glm::vec3(-100.0f,-100.0f,-20.0f),
-                             glm::vec3(100.0f,-100.0f,-20.0f));
+    ground_mesh.add_triangles(&ground_corners[0], ground_corners.size() / 3);
 
-    ground_mesh.add_triangle(glm::vec3(100.0f,-100.0f,-20.0f),
-                             glm::vec3(100.0f,100.0f,-20.0f),
-                             glm::vec3(-100.0f,100.0f,-20.0f));
     ground_mesh.calculate_normals();
+    // drop the welding and adjacency data, only the buffers are uploaded
+    std::size_t ground_bytes = ground_mesh.memory_usage();
+    ground_mesh.finalize();
+    std::cout << "Ground mesh: " << ground_bytes << " -> "
+              << ground_mesh.memory_usage() << " bytes" << std::endl;
 
     // load vertex and fragment shader
     glrfw::shader vertex(glrfw::shader_type::vertex,
@@ -178,6 +261,12 @@ int main(int argc, char* argv[])
     glrfw::program program_lines(std::move(vertex_lines),
                                  std::move(fragment_lines));
 
+    glrfw::shader vertex_id(glrfw::shader_type::vertex,
+                            glrfw::resource_path + std::string("id.vert"));
+    glrfw::shader fragment_id(glrfw::shader_type::fragment,
+                              glrfw::resource_path + std::string("id.frag"));
+    glrfw::program program_id(std::move(vertex_id), std::move(fragment_id));
+
     // create matrices
     auto projection =
         glm::perspective(45.0f, static_cast<float>(viewport_size.x) /
@@ -257,6 +346,14 @@ int main(int argc, char* argv[])
     std::cout << program_point.uniforms() << std::endl;
     program_lines.unbind();
 
+    std::cout << "Id Program: " << std::endl;
+    program_id.set_attribute(0, "in_Position");
+    program_id.link();
+    program_id.bind();
+    std::cout << program_id.attributes() << std::endl;
+    std::cout << program_id.uniforms() << std::endl;
+    program_id.unbind();
+
     
     // Set up view port
     glViewport(0,0,viewport_size.x,viewport_size.y);
@@ -308,21 +405,109 @@ int main(int argc, char* argv[])
              glrfw::error_type::uniform_not_found);
     glBindFramebuffer(GL_FRAMEBUFFER,0);
 
-    // Generate vertex buffer ojects
-    GLuint vbos[9];
-    glGenBuffers(9,&vbos[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[0]);
-    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(glm::vec3),
-                 &mesh.vertices[0], GL_STATIC_DRAW);
+    // Create framebuffer object for picking, object and triangle ids go
+    // into an integer color attachment of the size of the window
+    GLuint id_fbo;
+    glGenFramebuffers(1, &id_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, id_fbo);
+    GLuint id_tex;
+    glGenTextures(1, &id_tex);
+    glBindTexture(GL_TEXTURE_2D, id_tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, viewport_size.x,
+                 viewport_size.y, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           id_tex, 0);
+    GLuint id_depth;
+    glGenRenderbuffers(1, &id_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, id_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                          viewport_size.x, viewport_size.y);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, id_depth);
+    GLenum id_buffers[] = {GL_COLOR_ATTACHMENT0};
+    glDrawBuffers(1, id_buffers);
+    THROW_IF(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE,
+             glrfw::error_type::uniform_not_found);
+    glBindFramebuffer(GL_FRAMEBUFFER,0);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos[1]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                 mesh.triangles.size() * sizeof(glm::ivec3),
-                 &mesh.triangles[0], GL_STATIC_DRAW);
+    // Pixel buffers the id under the cursor is copied into, each guarded by
+    // a fence so it is only mapped once the copy has finished
+    GLuint id_pbo[2];
+    glGenBuffers(2, &id_pbo[0]);
+    for (GLuint pbo : id_pbo) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(GLuint), nullptr,
+                     GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    GLsync id_fence[2] = {nullptr, nullptr};
+    unsigned int id_frame = 0;
+    // frame each pixel buffer was last queued in
+    unsigned int id_queued[2] = {0, 0};
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbos[2]);
-    glBufferData(GL_ARRAY_BUFFER, mesh.vertex_normals.size() * sizeof(glm::vec3),
-                 &mesh.vertex_normals[0], GL_STATIC_DRAW);
+    // Generate vertex buffer ojects
+    GLuint vbos[11];
+    glGenBuffers(11,&vbos[0]);
+
+    // Upload the jaw into vbos 0 to 2 and its level of detail into 9 and
+    // 10, or the preview into both until the jaw is loaded. The vertex
+    // arrays keep pointing at the same buffers when they are refilled.
+    GLsizei jaw_indices = 0;
+    GLsizei lod_indices = 0;
+    auto upload = [](GLenum target, GLuint buffer, std::size_t bytes,
+                     const void* data) {
+        glBindBuffer(target, buffer);
+        glBufferData(target, static_cast<GLsizeiptr>(bytes), data,
+                     GL_STATIC_DRAW);
+    };
+    auto upload_jaw = [&]() {
+        // keep the element buffers out of whichever vertex array is bound
+        glBindVertexArray(0);
+        if (jaw) {
+            const glrfw::mesh_cache& full = jaw->mesh;
+            const glrfw::mesh_cache& lod = jaw->shadow_lod;
+            upload(GL_ARRAY_BUFFER, vbos[0],
+                   full.num_vertices() * sizeof(glm::vec3), full.vertices());
+            upload(GL_ELEMENT_ARRAY_BUFFER, vbos[1],
+                   full.num_triangles() * sizeof(glm::ivec3),
+                   full.triangles());
+            upload(GL_ARRAY_BUFFER, vbos[2],
+                   full.num_vertices() * sizeof(glm::vec3),
+                   full.vertex_normals());
+            upload(GL_ARRAY_BUFFER, vbos[9],
+                   lod.num_vertices() * sizeof(glm::vec3), lod.vertices());
+            upload(GL_ELEMENT_ARRAY_BUFFER, vbos[10],
+                   lod.num_triangles() * sizeof(glm::ivec3), lod.triangles());
+            jaw_indices = static_cast<GLsizei>(full.num_triangles() * 3);
+            lod_indices = static_cast<GLsizei>(lod.num_triangles() * 3);
+            std::cout << "ACMR: "
+                      << glrfw::acmr(full.triangles(), full.num_triangles(),
+                                     full.num_vertices())
+                      << std::endl;
+        }
+        else {
+            std::size_t vertex_bytes =
+                preview_mesh.vertices.size() * sizeof(glm::vec3);
+            std::size_t index_bytes =
+                preview_mesh.triangles.size() * sizeof(glm::ivec3);
+            upload(GL_ARRAY_BUFFER, vbos[0], vertex_bytes,
+                   preview_mesh.vertices.data());
+            upload(GL_ELEMENT_ARRAY_BUFFER, vbos[1], index_bytes,
+                   preview_mesh.triangles.data());
+            upload(GL_ARRAY_BUFFER, vbos[2], vertex_bytes,
+                   preview_mesh.vertex_normals.data());
+            upload(GL_ARRAY_BUFFER, vbos[9], vertex_bytes,
+                   preview_mesh.vertices.data());
+            upload(GL_ELEMENT_ARRAY_BUFFER, vbos[10], index_bytes,
+                   preview_mesh.triangles.data());
+            jaw_indices =
+                static_cast<GLsizei>(preview_mesh.triangles.size() * 3);
+            lod_indices = jaw_indices;
+        }
+    };
+    upload_jaw();
 
     glBindBuffer(GL_ARRAY_BUFFER,vbos[3]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
@@ -351,8 +536,8 @@ int main(int argc, char* argv[])
 
     // Generate vertex array objects and bind mesh vbos to the current
     // vao
-    GLuint vao[5];
-    glGenVertexArrays(5, &vao[0]);
+    GLuint vao[6];
+    glGenVertexArrays(6, &vao[0]);
 
     // Jaw 
     glBindVertexArray(vao[0]);
@@ -392,17 +577,35 @@ int main(int argc, char* argv[])
     glVertexAttribPointer(1,3,GL_FLOAT,GL_FALSE,0,0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos[7]);
 
+    // Jaw level of detail for the depth passes
+    glBindVertexArray(vao[5]);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER,vbos[9]);
+    glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,0,0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbos[10]);
+
     bool running = true;
     bool mouse_pressed = false;
 
     glm::vec2 start_pos;
     glm::vec2 cur_pos;
+    // cursor position, the point of the jaw under it and the last point
+    // measured with M
+    glm::vec2 hover_pos;
+    glrfw::pick_result hovered;
+    glrfw::pick_result measured;
 
     float rotation_angle = 0.0f;
     bool move_light = false;
     
     bool red_shadow = false;
 
+    bool compare_depth = false;
+
+    // whether the id pass runs, and the last object and triangle it found
+    bool gpu_picking = false;
+    GLuint gpu_picked[2] = {0, 0};
+
     glm::mat4 biasMatrix(0.5, 0.0, 0.0, 0.0, 0.0, 0.5, 0.0, 0.0, 0.0, 0.0, 0.5,
                          0.0, 0.5, 0.5, 0.5, 1.0);
 
@@ -430,6 +633,13 @@ int main(int argc, char* argv[])
                 viewport_size.x = event.size.width;
                 viewport_size.y = event.size.height;
                 glViewport(0, 0, viewport_size.x, viewport_size.y);
+                glBindTexture(GL_TEXTURE_2D, id_tex);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, viewport_size.x,
+                             viewport_size.y, 0, GL_RG_INTEGER,
+                             GL_UNSIGNED_INT, nullptr);
+                glBindRenderbuffer(GL_RENDERBUFFER, id_depth);
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+                                      viewport_size.x, viewport_size.y);
                 projection = glm::perspective(
                     45.0f, static_cast<float>(viewport_size.x) /
                                static_cast<float>(viewport_size.y),
@@ -454,6 +664,8 @@ int main(int argc, char* argv[])
                 mouse_pressed = false;
                 move_light = false;
             } else if (event.type == sf::Event::MouseMoved) {
+                hover_pos.x = static_cast<float>(event.mouseMove.x);
+                hover_pos.y = static_cast<float>(event.mouseMove.y);
                 if (mouse_pressed) {
                     cur_pos.x = static_cast<float>(event.mouseMove.x);
                     cur_pos.y = static_cast<float>(event.mouseMove.y);
@@ -465,10 +677,48 @@ int main(int argc, char* argv[])
                     program_shadow.unbind();
                     red_shadow = !red_shadow;
 
+                } else if (event.key.code == sf::Keyboard::C) {
+                    compare_depth = true;
+                } else if (event.key.code == sf::Keyboard::I) {
+                    gpu_picking = !gpu_picking;
+                } else if (event.key.code == sf::Keyboard::M &&
+                           hovered.triangle != -1) {
+                    std::cout << "triangle " << hovered.triangle << " at "
+                              << glm::to_string(hovered.position);
+                    if (measured.triangle != -1) {
+                        std::cout << ", distance to last point "
+                                  << glm::distance(hovered.position,
+                                                   measured.position);
+                    }
+                    std::cout << std::endl;
+                    measured = hovered;
                 }
             }
         }
 
+        // switch from the preview to the jaw once it has loaded
+        if (loading.valid() && is_ready(loading)) {
+            jaw = loading.get();
+            upload_jaw();
+            preview_mesh = glrfw::mesh();
+        }
+
+        // pick the jaw under the cursor in model space
+        if (jaw) {
+            glm::mat4 to_model = glm::inverse(projection * view * model);
+            glm::vec2 ndc(
+                2.0f * hover_pos.x / static_cast<float>(viewport_size.x) -
+                    1.0f,
+                1.0f -
+                    2.0f * hover_pos.y / static_cast<float>(viewport_size.y));
+            glm::vec4 from = to_model * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 to = to_model * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(from) / from.w;
+            hovered = jaw->pick_tree.pick(
+                glrfw::ray(origin, glm::vec3(to) / to.w - origin, 0.0f, 1.0f),
+                jaw->mesh.vertices(), jaw->mesh.triangles());
+        }
+
         if (mouse_pressed) {
             if( cur_pos != start_pos) {
                 update(view, model, normal, start_pos, cur_pos, viewport_size.x,
@@ -510,12 +760,11 @@ int main(int argc, char* argv[])
         glEnable(GL_POLYGON_OFFSET_FILL);
         
         // Render jaw to depth map from light source
-        glBindVertexArray(vao[0]);
+        glBindVertexArray(vao[5]);
         program_depth.bind();
         program_depth.set_uniform("projectionMatrix", depth_projection);
         program_depth.set_uniform("modelviewMatrix", depth_view * model);
-        glDrawElements(GL_TRIANGLES, mesh.triangles.size() * 3,
-                        GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLES, lod_indices, GL_UNSIGNED_INT, nullptr);
 
         // Render ground plane from light source
         glBindVertexArray(vao[4]);
@@ -525,19 +774,127 @@ int main(int argc, char* argv[])
                        GL_UNSIGNED_INT, nullptr);
         program_depth.unbind();
         glDisable(GL_POLYGON_OFFSET_FILL);
+
+        // Compare the depth map against the software rasterizer, once the
+        // jaw has loaded
+        if (compare_depth && jaw) {
+            compare_depth = false;
+            const glrfw::mesh_cache& shadow_lod = jaw->shadow_lod;
+            glrfw::depth_rasterizer raster(depthmap_size.x, depthmap_size.y);
+            raster.polygon_offset(5.5f, 100.0f);
+            raster.draw(shadow_lod.vertices(), shadow_lod.num_vertices(),
+                        shadow_lod.triangles(), shadow_lod.num_triangles(),
+                        depth_projection * depth_view * model, 0);
+            raster.draw(ground_mesh, depth_projection * depth_view, 0);
+            std::vector<float> expected = raster.depths();
+            std::vector<float> actual(expected.size());
+            glBindTexture(GL_TEXTURE_2D, depth_tex[0]);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_FLOAT,
+                          &actual[0]);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            float max_difference = 0.0f;
+            std::size_t differing = 0;
+            for (std::size_t i = 0; i < actual.size(); ++i) {
+                float difference = std::abs(actual[i] - expected[i]);
+                max_difference = std::max(max_difference, difference);
+                differing += difference > 1e-4f;
+            }
+            std::cout << "depth map: " << differing << " of " << actual.size()
+                      << " texels differ from the software rasterizer, "
+                      << "largest difference " << max_difference << std::endl;
+        }
         
+        // Render object and triangle ids and queue the pixel under the
+        // cursor for readback, results arrive a frame or two later
+        if (gpu_picking) {
+            // apply the older readback first, so a newer one that finished
+            // in the same frame is not overwritten by it
+            unsigned int oldest = id_queued[0] <= id_queued[1] ? 0 : 1;
+            for (unsigned int i = 0; i < 2; ++i) {
+                unsigned int slot = (oldest + i) % 2;
+                if (id_fence[slot] == nullptr) {
+                    continue;
+                }
+                GLenum state = glClientWaitSync(id_fence[slot], 0, 0);
+                if (state != GL_ALREADY_SIGNALED &&
+                    state != GL_CONDITION_SATISFIED) {
+                    continue;
+                }
+                glDeleteSync(id_fence[slot]);
+                id_fence[slot] = nullptr;
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, id_pbo[slot]);
+                const GLuint* id = static_cast<const GLuint*>(
+                    glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                     2 * sizeof(GLuint), GL_MAP_READ_BIT));
+                if (id == nullptr) {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    continue;
+                }
+                if (id[0] != gpu_picked[0] || id[1] != gpu_picked[1]) {
+                    gpu_picked[0] = id[0];
+                    gpu_picked[1] = id[1];
+                    std::cout << "gpu pick: object " << id[0];
+                    if (id[0] != 0) {
+                        std::cout << " triangle " << id[1] - 1;
+                    }
+                    std::cout << std::endl;
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            }
+
+            glBindFramebuffer(GL_FRAMEBUFFER, id_fbo);
+            glViewport(0, 0, viewport_size.x, viewport_size.y);
+            GLuint background[] = {0, 0, 0, 0};
+            glClearBufferuiv(GL_COLOR, 0, background);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            program_id.bind();
+            program_id.set_uniform("projectionMatrix", projection);
+            glBindVertexArray(vao[0]);
+            program_id.set_uniform("modelviewMatrix", view * model);
+            program_id.set_uniform("object_id", 1);
+            glDrawElements(GL_TRIANGLES, jaw_indices, GL_UNSIGNED_INT,
+                           nullptr);
+            glBindVertexArray(vao[4]);
+            program_id.set_uniform("modelviewMatrix", view);
+            program_id.set_uniform("object_id", 2);
+            glDrawElements(GL_TRIANGLES, ground_mesh.triangles.size() * 3,
+                           GL_UNSIGNED_INT, nullptr);
+            program_id.unbind();
+
+            // a busy pixel buffer is skipped instead of waited for
+            unsigned int frame = id_frame++;
+            unsigned int slot = frame % 2;
+            if (id_fence[slot] == nullptr) {
+                id_queued[slot] = frame;
+                GLint x = std::min(std::max(static_cast<GLint>(hover_pos.x), 0),
+                                   viewport_size.x - 1);
+                GLint y = std::min(std::max(viewport_size.y - 1 -
+                                                static_cast<GLint>(hover_pos.y),
+                                            0),
+                                   viewport_size.y - 1);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, id_pbo[slot]);
+                glReadBuffer(GL_COLOR_ATTACHMENT0);
+                glReadPixels(x, y, 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT,
+                             nullptr);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                id_fence[slot] =
+                    glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
         // Configure framebuffer for helper window
         glBindFramebuffer(GL_FRAMEBUFFER, fbo[1]);
         glViewport(0,0,depthmap_size.x,depthmap_size.y);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Draw jaw from light source
-        glBindVertexArray(vao[0]);
+        glBindVertexArray(vao[5]);
         program_depth.bind();
         program_depth.set_uniform("projectionMatrix", depth_projection);
         program_depth.set_uniform("modelviewMatrix", depth_view * model);
-        glDrawElements(GL_TRIANGLES, mesh.triangles.size() * 3,
-                        GL_UNSIGNED_INT, nullptr);
+        glDrawElements(GL_TRIANGLES, lod_indices, GL_UNSIGNED_INT, nullptr);
 
         // Draw ground plane from light source
         glBindVertexArray(vao[4]);
@@ -561,8 +918,7 @@ int main(int argc, char* argv[])
         program_shadow.set_uniform("lightpos",light_pos);
         program_shadow.set_uniform("shadowMatrix",shadow_matrix);
         program_shadow.set_uniform("ShadowMap", 0);
-        glDrawElements(GL_TRIANGLES, mesh.triangles.size() * 3, GL_UNSIGNED_INT,
-                        nullptr);
+        glDrawElements(GL_TRIANGLES, jaw_indices, GL_UNSIGNED_INT, nullptr);
 
         // Render ground plane with shadows
         glBindVertexArray(vao[4]);
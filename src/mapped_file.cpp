@@ -0,0 +1,113 @@
+#include "mapped_file.hpp"
+#include "error.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace glrfw {
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const std::string& file) : data_(nullptr), size_(0)
+{
+    HANDLE fd = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+    THROW_IF(fd == INVALID_HANDLE_VALUE, error_type::file_not_found);
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(fd, &file_size);
+    size_ = static_cast<std::size_t>(file_size.QuadPart);
+    if (size_ > 0) {
+        HANDLE mapping =
+            CreateFileMappingA(fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            data_ = static_cast<const char*>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(fd);
+    THROW_IF(size_ > 0 && data_ == nullptr, error_type::file_not_found);
+}
+
+void mapped_file::unmap()
+{
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#else
+
+mapped_file::mapped_file(const std::string& file) : data_(nullptr), size_(0)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    THROW_IF(fd == -1, error_type::file_not_found);
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size_ = static_cast<std::size_t>(info.st_size);
+        void* ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            // records are consumed front to back exactly once
+            madvise(ptr, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(ptr);
+        }
+    }
+    close(fd);
+    THROW_IF(size_ > 0 && data_ == nullptr, error_type::file_not_found);
+}
+
+void mapped_file::unmap()
+{
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
+
+mapped_file::mapped_file(mapped_file&& other)
+    : data_(other.data_), size_(other.size_)
+{
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other)
+{
+    if (this != &other) {
+        unmap();
+        data_ = other.data_;
+        size_ = other.size_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+mapped_file::~mapped_file()
+{
+    unmap();
+}
+
+const char* mapped_file::data() const
+{
+    return data_;
+}
+
+std::size_t mapped_file::size() const
+{
+    return size_;
+}
+
+} // end namespace glrfw
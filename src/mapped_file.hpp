@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace glrfw {
+
+// Read-only memory mapping of a whole file. The mapping is released when
+// the object is destroyed.
+class mapped_file {
+public:
+    mapped_file(const std::string& file);
+
+    mapped_file(const mapped_file&) = delete;
+
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other);
+
+    mapped_file& operator=(mapped_file&& other);
+
+    ~mapped_file();
+
+    const char* data() const;
+
+    std::size_t size() const;
+
+private:
+    void unmap();
+
+    const char* data_;
+
+    std::size_t size_;
+};
+
+} // end namespace glrfw
+
+#endif
@@ -1,80 +1,538 @@
 #include "mesh.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <numeric>
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
+#include "bvh.hpp"
+#include "kernels.hpp"
+#include "mapped_file.hpp"
+#include "optimize.hpp"
+#include "parallel.hpp"
 
 namespace glrfw {
 
+using detail::parallel_ranges;
+using detail::thread_count;
+
+namespace {
+
+const std::size_t stl_header_size = 84;
+
+const std::size_t stl_record_size = 50;
+
+// Number of records decoded from the mapping before they are welded.
+const std::size_t stl_batch_size = 4096;
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+              "glm::vec3 must be tightly packed");
+
+static_assert(offsetof(stl_triangle, c) == 3 * sizeof(glm::vec3),
+              "stl_triangle must match the stl record layout");
+
+// Triangles of one chunk, indexed into the chunk's own vertex table.
+struct partial_mesh {
+    partial_mesh() : vertices(), triangles(), partitions()
+    {
+    }
+
+    std::vector<glm::vec3> vertices;
+
+    std::vector<glm::ivec3> triangles;
+
+    // local indices of the vertices in each hash partition, ascending
+    std::vector<std::vector<int>> partitions;
+};
+
+// Hash partition of vertex out of num_parts. Taken from the high bits, so
+// the vertex tables of the partitions still use all their slots.
+std::size_t hash_partition(const glm::vec3& vertex, std::size_t num_parts)
+{
+    return (vertex_table::hash(vertex) >> (4 * sizeof(std::size_t))) %
+           num_parts;
+}
+
+std::size_t stl_triangle_count(const mapped_file& stl)
+{
+    THROW_IF(stl.size() < stl_header_size, error_type::invalid_file_format);
+    uint32_t num_tri = 0;
+    std::memcpy(&num_tri, stl.data() + 80, sizeof(uint32_t));
+    THROW_IF(stl.size() !=
+                 stl_header_size + std::size_t(num_tri) * stl_record_size,
+             error_type::invalid_file_format);
+    return num_tri;
+}
+
+void weld_records(const char* records, std::size_t first, std::size_t last,
+                  partial_mesh& part)
+{
+    vertex_table indices;
+    indices.reserve((last - first) / 2 + 1);
+    part.triangles.reserve(last - first);
+    std::vector<glm::vec3> corners(3 * stl_batch_size);
+    for (std::size_t begin = first; begin < last; begin += stl_batch_size) {
+        std::size_t count = std::min(stl_batch_size, last - begin);
+        detail::decode_stl_records(records + begin * stl_record_size, count,
+                                   &corners[0]);
+        for (std::size_t i = 0; i < 3 * count; i += 3) {
+            glm::ivec3 tri;
+            for (int k = 0; k < 3; ++k) {
+                const glm::vec3& corner =
+                    corners[i + static_cast<std::size_t>(k)];
+                auto result = indices.insert(
+                    corner, static_cast<int>(part.vertices.size()));
+                if (result.second) {
+                    part.vertices.push_back(corner);
+                }
+                tri[k] = result.first;
+            }
+            part.triangles.push_back(tri);
+        }
+    }
+}
+
+// Fills out with the triangles around each of num_vertices vertices, in
+// ascending order.
+void fill_adjacency(const std::vector<glm::ivec3>& triangles,
+                    std::size_t num_vertices, arena* scratch,
+                    adjacency& out)
+{
+    // count the triangles of every vertex, shifted by one
+    std::vector<int> offsets(num_vertices + 1, 0);
+    for (const glm::ivec3& tri : triangles) {
+        ++offsets[tri.x + 1];
+        ++offsets[tri.y + 1];
+        ++offsets[tri.z + 1];
+    }
+    for (std::size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    // fill, keeping the triangles of a vertex in ascending order
+    std::vector<int> faces(3 * triangles.size());
+    scratch_vector<int> cursor(offsets.begin(), offsets.end() - 1, scratch);
+    for (std::size_t i = 0; i < triangles.size(); ++i) {
+        int tri_index = static_cast<int>(i);
+        faces[cursor[triangles[i].x]++] = tri_index;
+        faces[cursor[triangles[i].y]++] = tri_index;
+        faces[cursor[triangles[i].z]++] = tri_index;
+    }
+    out.offsets.swap(offsets);
+    out.faces.swap(faces);
+}
+
+// Adds the area weighted normal of num_tri triangles to their corners in
+// out, which holds the vertices from first_vertex on.
+void scatter_normals(const glm::ivec3* triangles,
+                     const glm::vec3* face_normals, const float* areas,
+                     std::size_t num_tri, int first_vertex, glm::vec3* out)
+{
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        // degenerate triangles have no normal to contribute
+        if (!(areas[i] > 0.0f)) {
+            continue;
+        }
+        glm::ivec3 tri = triangles[i] - first_vertex;
+        glm::vec3 weighted = face_normals[i] * areas[i];
+        out[tri.x] += weighted;
+        out[tri.y] += weighted;
+        out[tri.z] += weighted;
+    }
+}
+
+// Scales count normals to unit length, zero normals are left untouched.
+void normalize_normals(glm::vec3* normals, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        float length = glm::length(normals[i]);
+        if (length > 0.0f) {
+            normals[i] /= length;
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+adjacency::adjacency() : offsets(), faces()
+{
+}
+
+int adjacency::size(int vertex) const
+{
+    return offsets[vertex + 1] - offsets[vertex];
+}
+
+const int* adjacency::begin(int vertex) const
+{
+    return faces.data() + offsets[vertex];
+}
+
+const int* adjacency::end(int vertex) const
+{
+    return faces.data() + offsets[vertex + 1];
+}
+
 mesh::mesh()
-    : vertices(std::vector<glm::vec3>()),
+    : scratch(nullptr),
+      vertices(std::vector<glm::vec3>()),
       vertex_normals(std::vector<glm::vec3>()),
       face_normals(std::vector<glm::vec3>()),
       triangles(std::vector<glm::ivec3>()),
-      indices(std::unordered_map<glm::vec3,int,glm_hash,glm_hash>()),
-      neighbors(std::unordered_map<int, std::vector<int>>())
+      indices(vertex_table()),
+      neighbors(adjacency()),
+      hierarchy(nullptr)
 {
 }
 
 void mesh::add_triangle(const glm::vec3& a, const glm::vec3& b,
                         const glm::vec3& c)
 {
-    int index_a = find_index(a);
-    int index_b = find_index(b);
-    int index_c = find_index(c);
-    
-    index_a = update_vertex(a, index_a);
-    index_b = update_vertex(b, index_b);
-    index_c = update_vertex(c, index_c);
+    int index_a = add_vertex(a);
+    int index_b = add_vertex(b);
+    int index_c = add_vertex(c);
 
     triangles.push_back(glm::ivec3(index_a, index_b, index_c));
-    glm::vec3 normal(glm::normalize(glm::cross((b - a), (c - a))));
-    face_normals.push_back(normal);
-
-    int tri_index = static_cast<int>(triangles.size()) - 1;
-    update_neighbors(index_a, tri_index);
-    update_neighbors(index_b, tri_index);
-    update_neighbors(index_c, tri_index);
 }
-void mesh::calculate_normals()
+
+void mesh::add_triangles(const glm::vec3* corners, std::size_t count,
+                         const glm::vec3* normals)
 {
-    vertex_normals = std::vector<glm::vec3>(vertices.size());
-    for (int i = 0; i < static_cast<int>(vertices.size()); ++i) {
-        auto tri_indices = neighbors[i];
-        glm::vec3 temp(0, 0, 0);
-        for (auto iter : tri_indices) {
-            temp += face_normals[iter];
+    std::size_t first = triangles.size();
+    // grow geometrically, so batches of triangles stay amortised linear
+    auto reserve = [](auto& container, std::size_t size) {
+        if (container.capacity() < size) {
+            container.reserve(std::max(size, 2 * container.capacity()));
         }
-        vertex_normals[i] = temp / tri_indices.size();
+    };
+    reserve(triangles, first + count);
+    reserve(vertices, vertices.size() + count / 2 + 1);
+    if (indices.size() == 0 && !vertices.empty()) {
+        rebuild_indices();
+    }
+    indices.reserve(vertices.size() + count / 2 + 1);
+    if (normals != nullptr) {
+        // earlier triangles may not have their face normals yet
+        std::size_t missing = face_normals.size();
+        reserve(face_normals, first + count);
+        face_normals.resize(first);
+        compute_face_normals(vertices.data(), triangles.data() + missing,
+                             first - missing, face_normals.data() + missing);
+        face_normals.insert(face_normals.end(), normals, normals + count);
+    }
+    for (std::size_t i = 0; i < 3 * count; i += 3) {
+        int index_a = add_vertex(corners[i]);
+        int index_b = add_vertex(corners[i + 1]);
+        int index_c = add_vertex(corners[i + 2]);
+        triangles.push_back(glm::ivec3(index_a, index_b, index_c));
     }
 }
 
-void mesh::update_neighbors(int vert_index, int tri_index)
+void mesh::calculate_face_normals(unsigned int num_threads)
 {
-    auto iter = neighbors.find(vert_index);
-    if (iter != neighbors.end()) {
-        iter->second.push_back(tri_index);
+    face_normals.resize(triangles.size());
+    parallel_ranges(thread_count(num_threads, triangles.size()),
+                    triangles.size(),
+                    [this](std::size_t first, std::size_t last) {
+                        compute_face_normals(
+                            vertices.data(), triangles.data() + first,
+                            last - first, face_normals.data() + first);
+                    });
+}
+
+void mesh::calculate_normals(unsigned int num_threads)
+{
+    // every worker takes a contiguous range of triangles
+    unsigned int workers = thread_count(num_threads, triangles.size());
+    auto range_first = [this, workers](std::size_t worker) {
+        return triangles.size() * worker / workers;
+    };
+
+    // face normals, and the lowest and highest vertex of every range
+    scratch_vector<float> areas(triangles.size(), scratch);
+    face_normals.resize(triangles.size());
+    std::vector<int> lower(workers, 0);
+    std::vector<int> upper(workers, -1);
+    parallel_ranges(
+        workers, workers,
+        [this, &range_first, &areas, &lower, &upper](std::size_t first,
+                                                     std::size_t last) {
+            for (std::size_t w = first; w < last; ++w) {
+                std::size_t begin = range_first(w);
+                std::size_t end = range_first(w + 1);
+                compute_face_normals(vertices.data(), triangles.data() + begin,
+                                     end - begin, face_normals.data() + begin,
+                                     areas.data() + begin);
+                for (std::size_t i = begin; i < end; ++i) {
+                    const glm::ivec3& tri = triangles[i];
+                    int low = std::min(tri.x, std::min(tri.y, tri.z));
+                    int high = std::max(tri.x, std::max(tri.y, tri.z));
+                    lower[w] = i == begin ? low : std::min(lower[w], low);
+                    upper[w] = i == begin ? high : std::max(upper[w], high);
+                }
+            }
+        });
+
+    vertex_normals.assign(vertices.size(), glm::vec3(0, 0, 0));
+    if (workers <= 1) {
+        scatter_normals(triangles.data(), face_normals.data(), areas.data(),
+                        triangles.size(), 0, vertex_normals.data());
+        normalize_normals(vertex_normals.data(), vertex_normals.size());
+        return;
+    }
+
+    // Every worker scatters into its own buffer, which only spans the
+    // vertices its triangles use. parse_stl numbers vertices in order of
+    // first use, so the buffers barely overlap.
+    std::vector<scratch_vector<glm::vec3>> partial;
+    partial.reserve(workers);
+    for (unsigned int w = 0; w < workers; ++w) {
+        partial.emplace_back(static_cast<std::size_t>(upper[w] - lower[w] + 1),
+                             glm::vec3(0, 0, 0), scratch);
+    }
+    parallel_ranges(
+        workers, workers,
+        [this, &range_first, &areas, &lower, &partial](std::size_t first,
+                                                       std::size_t last) {
+            for (std::size_t w = first; w < last; ++w) {
+                std::size_t begin = range_first(w);
+                scatter_normals(triangles.data() + begin,
+                                face_normals.data() + begin,
+                                areas.data() + begin,
+                                range_first(w + 1) - begin, lower[w],
+                                partial[w].data());
+            }
+        });
+
+    // add up the buffers covering each vertex in worker order
+    parallel_ranges(
+        workers, vertices.size(),
+        [this, workers, &lower, &upper, &partial](std::size_t first,
+                                                  std::size_t last) {
+            for (unsigned int w = 0; w < workers; ++w) {
+                std::size_t begin = std::max(
+                    first, static_cast<std::size_t>(lower[w]));
+                std::size_t end = std::min(
+                    last, static_cast<std::size_t>(upper[w] + 1));
+                for (std::size_t i = begin; i < end; ++i) {
+                    vertex_normals[i] +=
+                        partial[w][i - static_cast<std::size_t>(lower[w])];
+                }
+            }
+            normalize_normals(vertex_normals.data() + first, last - first);
+        });
+}
+
+bool mesh::has_neighbors() const
+{
+    return neighbors.offsets.size() == vertices.size() + 1 &&
+           neighbors.faces.size() == 3 * triangles.size();
+}
+
+void mesh::build_neighbors()
+{
+    fill_adjacency(triangles, vertices.size(), scratch, neighbors);
+}
+
+const adjacency& mesh::get_neighbors()
+{
+    if (!has_neighbors()) {
+        build_neighbors();
+    }
+    return neighbors;
+}
+
+void mesh::build_hierarchy(unsigned int num_threads)
+{
+    hierarchy = std::make_shared<const bvh>(*this, num_threads);
+}
+
+bool mesh::has_hierarchy() const
+{
+    return hierarchy && hierarchy->num_triangles() == triangles.size();
+}
+
+pick_result mesh::pick(const ray& r)
+{
+    if (!has_hierarchy()) {
+        build_hierarchy();
+    }
+    return hierarchy->pick(r, vertices.data(), triangles.data());
+}
+
+void mesh::rebuild_indices()
+{
+    indices.clear();
+    indices.reserve(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        indices.insert(vertices[i], static_cast<int>(i));
+    }
+}
+
+void mesh::finalize()
+{
+    indices.clear();
+    neighbors = adjacency();
+    vertices.shrink_to_fit();
+    vertex_normals.shrink_to_fit();
+    face_normals.shrink_to_fit();
+    triangles.shrink_to_fit();
+}
+
+std::size_t mesh::memory_usage() const
+{
+    return vertices.capacity() * sizeof(glm::vec3) +
+           vertex_normals.capacity() * sizeof(glm::vec3) +
+           face_normals.capacity() * sizeof(glm::vec3) +
+           triangles.capacity() * sizeof(glm::ivec3) +
+           indices.memory_usage() +
+           (neighbors.offsets.capacity() + neighbors.faces.capacity()) *
+               sizeof(int) +
+           (hierarchy ? hierarchy->memory_usage() : 0);
+}
+
+std::size_t mesh::merge_vertices(float epsilon)
+{
+    if (!(epsilon > 0.0f) || vertices.empty()) {
+        return 0;
+    }
+    auto cell_of = [epsilon](const glm::vec3& vertex) {
+        return glm::i64vec3(glm::floor(vertex / epsilon));
+    };
+    // cells are hashed, so distant cells may share a key; the distance
+    // test below keeps that harmless
+    auto cell_key = [](const glm::i64vec3& cell) {
+        return (uint64_t(cell.x) * UINT64_C(73856093)) ^
+               (uint64_t(cell.y) * UINT64_C(19349663)) ^
+               (uint64_t(cell.z) * UINT64_C(83492791));
+    };
+
+    // representatives of each cell as linked lists through next
+    typedef std::pair<const uint64_t, int> cell_entry;
+    std::unordered_map<uint64_t, int, std::hash<uint64_t>,
+                       std::equal_to<uint64_t>, arena_allocator<cell_entry>>
+        cells(vertices.size(), std::hash<uint64_t>(),
+              std::equal_to<uint64_t>(), scratch);
+    scratch_vector<int> next(scratch);
+    std::vector<glm::vec3> welded;
+    scratch_vector<int> remap(vertices.size(), scratch);
+    float epsilon2 = epsilon * epsilon;
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        const glm::vec3& vertex = vertices[i];
+        glm::i64vec3 cell = cell_of(vertex);
+        int found = -1;
+        for (int64_t dz = -1; dz <= 1 && found == -1; ++dz) {
+            for (int64_t dy = -1; dy <= 1 && found == -1; ++dy) {
+                for (int64_t dx = -1; dx <= 1 && found == -1; ++dx) {
+                    auto iter =
+                        cells.find(cell_key(cell + glm::i64vec3(dx, dy, dz)));
+                    if (iter == cells.end()) {
+                        continue;
+                    }
+                    for (int rep = iter->second; rep != -1; rep = next[rep]) {
+                        glm::vec3 diff = welded[rep] - vertex;
+                        if (glm::dot(diff, diff) <= epsilon2) {
+                            found = rep;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if (found == -1) {
+            found = static_cast<int>(welded.size());
+            welded.push_back(vertex);
+            auto result = cells.insert(std::make_pair(cell_key(cell), found));
+            next.push_back(result.second ? -1 : result.first->second);
+            result.first->second = found;
+        }
+        remap[i] = found;
+    }
+    if (welded.size() == vertices.size()) {
+        return 0;
+    }
+
+    // drop the triangles that collapsed, then the representatives no
+    // triangle uses any more, keeping the order of the others
+    std::size_t kept = 0;
+    scratch_vector<int> used(welded.size(), 0, scratch);
+    for (const glm::ivec3& tri : triangles) {
+        glm::ivec3 mapped(remap[tri.x], remap[tri.y], remap[tri.z]);
+        if (mapped.x == mapped.y || mapped.y == mapped.z ||
+            mapped.x == mapped.z) {
+            continue;
+        }
+        used[mapped.x] = used[mapped.y] = used[mapped.z] = 1;
+        triangles[kept++] = mapped;
+    }
+    triangles.resize(kept);
+    scratch_vector<int> compact(welded.size(), -1, scratch);
+    std::size_t num_used = 0;
+    for (std::size_t i = 0; i < welded.size(); ++i) {
+        if (used[i]) {
+            compact[i] = static_cast<int>(num_used);
+            welded[num_used++] = welded[i];
+        }
+    }
+    welded.resize(num_used);
+    for (glm::ivec3& tri : triangles) {
+        tri = glm::ivec3(compact[tri.x], compact[tri.y], compact[tri.z]);
+    }
+
+    // every old position keeps welding onto its representative, unless
+    // that was removed
+    indices.clear();
+    indices.reserve(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        int index = compact[remap[i]];
+        if (index != -1) {
+            indices.insert(vertices[i], index);
+        }
+    }
+    std::size_t removed = vertices.size() - welded.size();
+    vertices.swap(welded);
+
+    if (!neighbors.offsets.empty()) {
+        build_neighbors();
+    }
+    if (hierarchy) {
+        build_hierarchy();
+    }
+    if (!vertex_normals.empty()) {
+        calculate_normals();
     }
     else {
-        neighbors.insert(
-            std::make_pair(vert_index, std::vector<int>({tri_index})));
+        calculate_face_normals();
     }
+    return removed;
 }
 
 int mesh::find_index(const glm::vec3& vertex)
 {
-    auto iter = indices.find(vertex);
-    if (iter != indices.end()) 
-        return iter->second;
-    else
-        return -1;
+    if (indices.size() == 0 && !vertices.empty()) {
+        rebuild_indices();
+    }
+    return indices.find(vertex);
 }
+
+int mesh::add_vertex(const glm::vec3& vertex)
+{
+    if (indices.size() == 0 && !vertices.empty()) {
+        rebuild_indices();
+    }
+    auto result = indices.insert(vertex, static_cast<int>(vertices.size()));
+    if (result.second) {
+        vertices.push_back(vertex);
+    }
+    return result.first;
+}
+
 int mesh::update_vertex(const glm::vec3& vertex, int index)
 {
     if (index == -1) {
         vertices.push_back(vertex);
-        indices.insert(
-            std::make_pair(vertex, static_cast<int>(vertices.size()) - 1));
+        indices.insert(vertex, static_cast<int>(vertices.size()) - 1);
         return static_cast<int>(vertices.size()) - 1;
     }
     else {
@@ -105,12 +563,13 @@ void mesh::print_normals()
 
 void mesh::print_neighbors()
 {
+    get_neighbors();
     for (int i = 0; i < static_cast<int>(vertices.size()); ++i) {
         std::cout << "Vertex: " << vertices[i] << std::endl;
         std::cout << "Tringles:" << std::endl;
-        auto faces = neighbors.find(i);
-        for (auto iter : faces->second) {
-            std::cout << iter << std::endl;
+        for (const int* face = neighbors.begin(i); face != neighbors.end(i);
+             ++face) {
+            std::cout << *face << std::endl;
         }
     }
 }
@@ -123,31 +582,378 @@ void mesh::centralize()
     center /= vertices.size();
     std::transform(vertices.begin(), vertices.end(), vertices.begin(),
                    [&center](const glm::vec3& cur) { return cur - center; });
+    if (has_hierarchy()) {
+        // copies may still share the old one
+        std::shared_ptr<bvh> moved = std::make_shared<bvh>(*hierarchy);
+        moved->refit(vertices, triangles);
+        hierarchy = moved;
+    }
 }
 
-mesh parse_stl(const std::string& file)
+std::pair<float, float> mesh::optimize_vertex_cache(int cache_size)
+{
+    float before = acmr(triangles.data(), triangles.size(), vertices.size(),
+                        cache_size);
+    std::vector<int> order = tipsify(triangles.data(), triangles.size(),
+                                     vertices.size(), cache_size);
+    std::vector<glm::ivec3> reordered(triangles.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        reordered[i] = triangles[static_cast<std::size_t>(order[i])];
+    }
+    if (face_normals.size() == triangles.size()) {
+        std::vector<glm::vec3> normals(face_normals.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            normals[i] = face_normals[static_cast<std::size_t>(order[i])];
+        }
+        face_normals.swap(normals);
+    }
+    triangles.swap(reordered);
+    if (!neighbors.offsets.empty()) {
+        build_neighbors();
+    }
+    if (hierarchy) {
+        build_hierarchy();
+    }
+    float after = acmr(triangles.data(), triangles.size(), vertices.size(),
+                       cache_size);
+    return std::make_pair(before, after);
+}
+
+void mesh::remap_vertices(const std::vector<int>& remap)
+{
+    auto apply = [&remap](std::vector<glm::vec3>& values) {
+        if (values.size() != remap.size()) {
+            return;
+        }
+        std::vector<glm::vec3> moved(values.size());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            moved[static_cast<std::size_t>(remap[i])] = values[i];
+        }
+        values.swap(moved);
+    };
+    apply(vertices);
+    apply(vertex_normals);
+    for (glm::ivec3& tri : triangles) {
+        tri = glm::ivec3(remap[static_cast<std::size_t>(tri.x)],
+                         remap[static_cast<std::size_t>(tri.y)],
+                         remap[static_cast<std::size_t>(tri.z)]);
+    }
+    if (indices.size() != 0) {
+        rebuild_indices();
+    }
+    if (!neighbors.offsets.empty()) {
+        build_neighbors();
+    }
+    if (hierarchy) {
+        build_hierarchy();
+    }
+}
+
+void mesh::reorder_vertices(vertex_order order)
+{
+    if (order == vertex_order::morton) {
+        remap_vertices(morton_order(vertices.data(), vertices.size()));
+    }
+    else {
+        remap_vertices(
+            fetch_order(triangles.data(), triangles.size(), vertices.size()));
+    }
+}
+
+namespace detail {
+
+void decode_stl_records(const char* records, std::size_t count,
+                        glm::vec3* corners)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        // skip face normal, copy the three corners in one go
+        std::memcpy(corners + 3 * i, records + i * stl_record_size + 12,
+                    3 * sizeof(glm::vec3));
+    }
+}
+}
+
+namespace {
+
+void weld_serial(mesh& mesh, const char* records, std::size_t num_tri)
+{
+    // a closed surface has about half as many vertices as triangles
+    mesh.indices.reserve(num_tri / 2 + 1);
+    mesh.triangles.reserve(num_tri);
+    mesh.vertices.reserve(num_tri / 2 + 1);
+    scratch_vector<glm::vec3> corners(3 * stl_batch_size, mesh.scratch);
+    for (std::size_t first = 0; first < num_tri; first += stl_batch_size) {
+        std::size_t count = std::min(stl_batch_size, num_tri - first);
+        detail::decode_stl_records(records + first * stl_record_size,
+                                   count, &corners[0]);
+        mesh.add_triangles(&corners[0], count);
+    }
+}
+
+void weld_parallel(mesh& mesh, const char* records, std::size_t num_tri,
+                   unsigned int num_threads)
+{
+    auto chunk_first = [num_tri, num_threads](std::size_t chunk) {
+        return num_tri * chunk / num_threads;
+    };
+
+    // weld every chunk on its own and sort its vertices into partitions
+    std::vector<partial_mesh> parts(num_threads);
+    parallel_ranges(
+        num_threads, num_threads,
+        [records, num_threads, &chunk_first, &parts](std::size_t first,
+                                                     std::size_t last) {
+            for (std::size_t c = first; c < last; ++c) {
+                partial_mesh& part = parts[c];
+                weld_records(records, chunk_first(c), chunk_first(c + 1),
+                             part);
+                part.partitions.resize(num_threads);
+                for (std::size_t i = 0; i < part.vertices.size(); ++i) {
+                    std::size_t p =
+                        hash_partition(part.vertices[i], num_threads);
+                    part.partitions[p].push_back(static_cast<int>(i));
+                }
+            }
+        });
+
+    // number the local vertices of all chunks one after the other
+    std::vector<std::size_t> base(num_threads + 1, 0);
+    for (unsigned int c = 0; c < num_threads; ++c) {
+        base[c + 1] = base[c] + parts[c].vertices.size();
+    }
+
+    // Equal positions share a partition, so every partition finds the
+    // first occurrence of its vertices on its own by visiting the chunks
+    // in order. Only these owners become vertices of the mesh.
+    std::vector<int> owner(base.back());
+    parallel_ranges(
+        num_threads, num_threads,
+        [num_threads, &parts, &base, &owner](std::size_t first,
+                                             std::size_t last) {
+            for (std::size_t p = first; p < last; ++p) {
+                vertex_table first_seen;
+                first_seen.reserve(base.back() / num_threads + 1);
+                for (unsigned int c = 0; c < num_threads; ++c) {
+                    for (int i : parts[c].partitions[p]) {
+                        int id = static_cast<int>(base[c]) + i;
+                        owner[static_cast<std::size_t>(id)] =
+                            first_seen.insert(parts[c].vertices[i], id).first;
+                    }
+                }
+            }
+        });
+
+    // The owners of a chunk keep their local order and follow those of
+    // the earlier chunks, so vertices are in order of their first
+    // appearance in the file, like in the serial path.
+    std::vector<std::size_t> offsets(num_threads + 1, 0);
+    parallel_ranges(
+        num_threads, num_threads,
+        [&base, &owner, &offsets](std::size_t first, std::size_t last) {
+            for (std::size_t c = first; c < last; ++c) {
+                for (std::size_t id = base[c]; id < base[c + 1]; ++id) {
+                    if (owner[id] == static_cast<int>(id)) {
+                        ++offsets[c + 1];
+                    }
+                }
+            }
+        });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<int> global(base.back());
+    mesh.vertices.resize(offsets.back());
+    parallel_ranges(
+        num_threads, num_threads,
+        [&mesh, &parts, &base, &owner, &offsets, &global](std::size_t first,
+                                                          std::size_t last) {
+            for (std::size_t c = first; c < last; ++c) {
+                std::size_t next = offsets[c];
+                for (std::size_t i = 0; i < parts[c].vertices.size(); ++i) {
+                    std::size_t id = base[c] + i;
+                    if (owner[id] == static_cast<int>(id)) {
+                        global[id] = static_cast<int>(next);
+                        mesh.vertices[next++] = parts[c].vertices[i];
+                    }
+                }
+            }
+        });
+
+    // every corner takes the global index of its owner
+    mesh.triangles.resize(num_tri);
+    parallel_ranges(
+        num_threads, num_threads,
+        [&mesh, &chunk_first, &parts, &base, &owner, &global](
+            std::size_t first, std::size_t last) {
+            for (std::size_t c = first; c < last; ++c) {
+                auto lookup = [&](int local) {
+                    std::size_t id = base[c] + static_cast<std::size_t>(local);
+                    return global[static_cast<std::size_t>(owner[id])];
+                };
+                const partial_mesh& part = parts[c];
+                for (std::size_t j = 0; j < part.triangles.size(); ++j) {
+                    const glm::ivec3& tri = part.triangles[j];
+                    mesh.triangles[chunk_first(c) + j] = glm::ivec3(
+                        lookup(tri.x), lookup(tri.y), lookup(tri.z));
+                }
+            }
+        });
+}
+
+// Position bits and corner number, sorted by weld_sorted.
+struct corner_key {
+    uint32_t key[3];
+
+    uint32_t corner;
+};
+
+// Digit of a 96 bit key, least significant digit first. The key is
+// ordered by x, then y, then z.
+uint32_t radix_digit(const corner_key& entry, int pass)
+{
+    return (entry.key[2 - pass / 2] >> (16 * (pass % 2))) & 0xffff;
+}
+
+void radix_sort(scratch_vector<corner_key>& keys)
+{
+    scratch_vector<std::size_t> offsets(65536, keys.get_allocator());
+    scratch_vector<corner_key> temp(keys.size(), keys.get_allocator());
+    for (int pass = 0; pass < 6; ++pass) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (const corner_key& entry : keys) {
+            ++offsets[radix_digit(entry, pass)];
+        }
+        // all keys share this digit, nothing to reorder
+        if (offsets[radix_digit(keys[0], pass)] == keys.size()) {
+            continue;
+        }
+        std::size_t sum = 0;
+        for (std::size_t& offset : offsets) {
+            std::size_t count = offset;
+            offset = sum;
+            sum += count;
+        }
+        for (const corner_key& entry : keys) {
+            temp[offsets[radix_digit(entry, pass)]++] = entry;
+        }
+        keys.swap(temp);
+    }
+}
+
+} // end of anonymous namespace
+
+mesh weld_sorted(const glm::vec3* corners, std::size_t num_tri,
+                 arena* scratch)
 {
-    std::ifstream stl(file, std::ios::in | std::ios::binary);
     mesh mesh;
-    if (stl.is_open()) {
-        // skip header
-        stl.seekg(80, std::ifstream::beg);
-        uint32_t num_tri = 0;
-        stl.read(reinterpret_cast<char*>(&num_tri), sizeof(uint32_t));
-        for (uint32_t i = 0; i < num_tri; i++) {
-            // skip face normals
-            stl.seekg(3 * sizeof(float), std::ifstream::cur);
-            glm::vec3 a, b, c;
-            stl.read(reinterpret_cast<char*>(&a), sizeof(a));
-            stl.read(reinterpret_cast<char*>(&b), sizeof(b));
-            stl.read(reinterpret_cast<char*>(&c), sizeof(c));
-            stl.seekg(sizeof(uint16_t), std::ifstream::cur);
-            mesh.add_triangle(a, b, c);
+    mesh.scratch = scratch;
+    if (num_tri == 0) {
+        return mesh;
+    }
+    scratch_vector<corner_key> keys(3 * num_tri, scratch);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        // adding +0 turns -0 into +0, so both weld like with operator==
+        glm::vec3 canonical = corners[i] + glm::vec3(0.0f);
+        std::memcpy(keys[i].key, &canonical, sizeof(keys[i].key));
+        keys[i].corner = static_cast<uint32_t>(i);
+    }
+    radix_sort(keys);
+
+    // equal positions are adjacent now, number them in one pass
+    scratch_vector<int> remap(keys.size(), scratch);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (i == 0 || std::memcmp(keys[i].key, keys[i - 1].key,
+                                  sizeof(keys[i].key)) != 0) {
+            mesh.vertices.push_back(corners[keys[i].corner]);
         }
+        remap[keys[i].corner] = static_cast<int>(mesh.vertices.size()) - 1;
+    }
+
+    mesh.triangles.resize(num_tri);
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        mesh.triangles[i] =
+            glm::ivec3(remap[3 * i], remap[3 * i + 1], remap[3 * i + 2]);
+    }
+    return mesh;
+}
+
+mesh parse_stl(const std::string& file, unsigned int num_threads,
+               weld_mode mode, arena* scratch)
+{
+    mapped_file stl(file);
+    std::size_t num_tri = stl_triangle_count(stl);
+    const char* records = stl.data() + stl_header_size;
+
+    num_threads = thread_count(num_threads, num_tri);
+
+    mesh mesh;
+    mesh.scratch = scratch;
+    if (mode == weld_mode::sort) {
+        scratch_vector<glm::vec3> corners(3 * num_tri, scratch);
+        detail::decode_stl_records(records, num_tri, corners.data());
+        mesh = weld_sorted(corners.data(), num_tri, scratch);
     }
     else {
-	    THROW_IF(!stl.is_open(),error_type::file_not_found);
+        if (num_threads == 1) {
+            weld_serial(mesh, records, num_tri);
+        }
+        else {
+            weld_parallel(mesh, records, num_tri, num_threads);
+        }
     }
+    mesh.calculate_normals(num_threads);
+    mesh.centralize();
+    return mesh;
+}
+
+std::size_t stream_stl(const std::string& file, std::size_t batch_size,
+                       const stl_callback& callback)
+{
+    std::ifstream stl(file, std::ios::in | std::ios::binary);
+    THROW_IF(!stl.is_open(), error_type::file_not_found);
+    stl.seekg(0, std::ifstream::end);
+    std::size_t file_size = static_cast<std::size_t>(stl.tellg());
+    THROW_IF(file_size < stl_header_size, error_type::invalid_file_format);
+    // skip header
+    stl.seekg(80, std::ifstream::beg);
+    uint32_t num_tri = 0;
+    stl.read(reinterpret_cast<char*>(&num_tri), sizeof(uint32_t));
+    THROW_IF(file_size !=
+                 stl_header_size + std::size_t(num_tri) * stl_record_size,
+             error_type::invalid_file_format);
+
+    batch_size = std::max<std::size_t>(1, batch_size);
+    std::vector<char> window(std::min<std::size_t>(batch_size, num_tri) *
+                             stl_record_size);
+    std::vector<stl_triangle> batch(window.size() / stl_record_size);
+    for (std::size_t first = 0; first < num_tri; first += batch_size) {
+        std::size_t count = std::min<std::size_t>(batch_size, num_tri - first);
+        stl.read(&window[0],
+                 static_cast<std::streamsize>(count * stl_record_size));
+        THROW_IF(!stl, error_type::invalid_file_format);
+        for (std::size_t i = 0; i < count; ++i) {
+            const char* record = &window[i * stl_record_size];
+            std::memcpy(&batch[i].normal, record, 4 * sizeof(glm::vec3));
+            std::memcpy(&batch[i].attribute, record + 4 * sizeof(glm::vec3),
+                        sizeof(uint16_t));
+        }
+        callback(&batch[0], count);
+    }
+    return num_tri;
+}
+
+mesh parse_stl_stream(const std::string& file)
+{
+    mesh mesh;
+    std::vector<glm::vec3> corners(3 * stl_batch_size);
+    stream_stl(file, stl_batch_size,
+               [&mesh, &corners](const stl_triangle* batch, std::size_t count) {
+                   for (std::size_t i = 0; i < count; ++i) {
+                       corners[3 * i] = batch[i].a;
+                       corners[3 * i + 1] = batch[i].b;
+                       corners[3 * i + 2] = batch[i].c;
+                   }
+                   mesh.add_triangles(&corners[0], count);
+               });
     mesh.calculate_normals();
     mesh.centralize();
     return mesh;
@@ -1,20 +1,74 @@
 #ifndef MESH_HPP
 #define MESH_HPP
 
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <unordered_map>
+#include "arena.hpp"
 #include "error.hpp"
+#include "ray.hpp"
+#include "vertex_table.hpp"
 
 namespace glrfw {
 
+// Triangles around each vertex in compressed sparse row form. The triangles
+// of vertex i are faces[offsets[i]] up to faces[offsets[i + 1]].
+struct adjacency {
+    adjacency();
+
+    int size(int vertex) const;
+
+    const int* begin(int vertex) const;
+
+    const int* end(int vertex) const;
+
+    std::vector<int> offsets;
+
+    std::vector<int> faces;
+};
+
+enum class vertex_order { fetch, morton };
+
+class bvh;
+
 class mesh {
 public:
     mesh();
 
+    // copies share the scratch arena and the hierarchy until they rebuild
+    // it
+    mesh(const mesh&) = default;
+
+    mesh& operator=(const mesh&) = default;
+
+    mesh(mesh&&) = default;
+
+    mesh& operator=(mesh&&) = default;
+
     void add_triangle(const glm::vec3& a, const glm::vec3& b,
                       const glm::vec3& c);
 
-    void calculate_normals();
+    // Adds count triangles given as 3 * count consecutive corners in one
+    // pass, reserving all containers up front. If normals is not null it
+    // holds one unit normal per triangle, which is stored as face normal
+    // until the next calculate_face_normals or calculate_normals.
+    void add_triangles(const glm::vec3* corners, std::size_t count,
+                       const glm::vec3* normals = nullptr);
+
+    // Calculates face normals, then unit vertex normals by adding the area
+    // weighted normal of every triangle to its corners. With more than one
+    // thread (0 uses all hardware threads) every thread scatters a range of
+    // triangles into a buffer of its own, and the buffers are added up per
+    // vertex afterwards. The sums are rounded in a different order then,
+    // so normals may differ from the serial ones in the last bits.
+    void calculate_normals(unsigned int num_threads = 1);
+
+    // Calculates the unit normal of every triangle in bulk.
+    // add_triangle only welds, face normals are filled in by this or by
+    // calculate_normals.
+    void calculate_face_normals(unsigned int num_threads = 1);
 
     void print_vertices();
 
@@ -24,14 +78,86 @@ public:
 
     void print_normals();
 
+    // Returns the index of vertex, appending it to vertices if it has not
+    // been seen before. The vertex table is rebuilt first if the mesh has
+    // vertices but no table, e.g. after finalize.
+    int add_vertex(const glm::vec3& vertex);
+
     int update_vertex(const glm::vec3& a, int index);
 
-    void update_neighbors(int vert_index, int tri_index);
+    // Rebuilds neighbors from triangles by counting the triangles of every
+    // vertex and then filling them in. neighbors are only built on request,
+    // add_triangle does not update them.
+    void build_neighbors();
+
+    // Whether neighbors match the current vertices and triangles.
+    bool has_neighbors() const;
+
+    // Returns neighbors, building them first if they are out of date.
+    const adjacency& get_neighbors();
+
+    // Builds the bounding volume hierarchy over the triangles used by pick
+    // with num_threads threads, 0 meaning all hardware threads.
+    void build_hierarchy(unsigned int num_threads = 0);
+
+    // Whether hierarchy exists and covers as many triangles as the mesh.
+    // Only the count is compared: the member functions of the mesh keep the
+    // hierarchy up to date, but any direct edit of vertices or triangles
+    // that keeps the number of triangles needs build_hierarchy() before the
+    // next pick, or pick returns wrong triangles and positions.
+    bool has_hierarchy() const;
+
+    // Closest triangle hit by r, building the hierarchy first if it is out
+    // of date. Queries take microseconds, so they can run every frame.
+    pick_result pick(const ray& r);
+
+    // Refills the vertex table from vertices.
+    void rebuild_indices();
+
+    // Frees the data only needed while building the mesh, the vertex table
+    // and neighbors, and shrinks all containers to fit. Both are rebuilt on
+    // demand by add_vertex and get_neighbors. The hierarchy is kept.
+    void finalize();
+
+    // Bytes allocated by the containers of the mesh.
+    std::size_t memory_usage() const;
+
+    // Welds vertices that lie within epsilon of each other, using a hash
+    // grid with cells of size epsilon so only neighboring cells have to be
+    // searched. Each vertex is merged into an earlier kept vertex in range,
+    // kept vertices do not move. Triangles that collapse are removed, then
+    // every vertex no triangle uses any more, and face normals are
+    // recalculated. Neighbors and vertex normals are rebuilt if they had
+    // been built before, as is the hierarchy. Returns by how many vertices
+    // the mesh shrank.
+    std::size_t merge_vertices(float epsilon);
 
     int find_index(const glm::vec3& vertex);
 
+    // Moves the mesh so the average vertex lies at the origin. The
+    // hierarchy is refitted if it had been built before.
     void centralize();
 
+    // Reorders triangles and their face normals for a post-transform vertex
+    // cache of cache_size entries with tipsify. Neighbors and the hierarchy
+    // are rebuilt if they had been built before. Returns the acmr before and
+    // after.
+    std::pair<float, float> optimize_vertex_cache(int cache_size = 16);
+
+    // Renumbers vertices and vertex normals so that vertex i moves to
+    // remap[i], and rewrites triangles to match. The vertex table,
+    // neighbors and the hierarchy are rebuilt if they had been built
+    // before.
+    void remap_vertices(const std::vector<int>& remap);
+
+    // Renumbers vertices with fetch_order or morton_order.
+    void reorder_vertices(vertex_order order = vertex_order::fetch);
+
+    // Arena for temporary buffers of calculate_normals, build_neighbors and
+    // merge_vertices, or null to use the heap. It is not owned and must
+    // outlive those calls; the mesh data itself always lives on the heap.
+    arena* scratch;
+
     std::vector<glm::vec3> vertices;
 
     std::vector<glm::vec3> vertex_normals;
@@ -40,25 +166,75 @@ public:
 
     std::vector<glm::ivec3> triangles;
 
-    struct glm_hash {
-        size_t operator()(const glm::vec3& k) const
-        {
-            return std::hash<float>()(k.x) ^ std::hash<float>()(k.y) ^
-                   std::hash<float>()(k.z);
-        }
+    vertex_table indices;
+    
+    adjacency neighbors;
 
-        bool operator()(const glm::vec3& a, const glm::vec3& b) const
-        {
-            return a == b;
-        } 
-    };
+    // Acceleration structure for pick, only built on request.
+    std::shared_ptr<const bvh> hierarchy;
+};
 
-    std::unordered_map<glm::vec3,int,glm_hash,glm_hash> indices;
-    
-    std::unordered_map<int, std::vector<int>> neighbors;
+enum class weld_mode { hash, sort };
+
+// Builds a mesh from num_tri triangles given as 3 * num_tri corners. The
+// corners are welded by radix sorting the bit patterns of their positions,
+// so vertices end up in sorted order regardless of the triangle order and
+// memory use is linear in num_tri. The returned mesh has no vertex table,
+// which is only built if further triangles are added, and no neighbors
+// yet. The sort buffers are taken from scratch if given, which
+// also becomes the scratch arena of the returned mesh.
+mesh weld_sorted(const glm::vec3* corners, std::size_t num_tri,
+                 arena* scratch = nullptr);
+
+// Loads a binary stl file through a memory mapping of the whole file. With
+// more than one thread the triangles are split into chunks which are welded
+// in parallel and merged afterwards; 0 uses all hardware threads. The
+// result does not depend on the number of threads. weld_mode::sort welds
+// with weld_sorted instead, which runs on a single thread. Vertex normals
+// are calculated with num_threads in both modes. If scratch is given, the
+// temporary buffers of the calling thread are taken from it and it becomes
+// the scratch arena of the returned mesh.
+mesh parse_stl(const std::string& file, unsigned int num_threads = 1,
+               weld_mode mode = weld_mode::hash, arena* scratch = nullptr);
+
+// One record of a binary stl file.
+struct stl_triangle {
+    stl_triangle() : normal(), a(), b(), c(), attribute(0)
+    {
+    }
+
+    glm::vec3 normal;
+
+    glm::vec3 a;
+
+    glm::vec3 b;
+
+    glm::vec3 c;
+
+    uint16_t attribute;
 };
 
-mesh parse_stl(const std::string& file);
+typedef std::function<void(const stl_triangle* batch, std::size_t count)>
+    stl_callback;
+
+// Reads a binary stl file in windows of batch_size records and passes each
+// window to callback. Only one window is held in memory at a time, so
+// arbitrarily large files can be processed. Returns the number of
+// triangles read.
+std::size_t stream_stl(const std::string& file, std::size_t batch_size,
+                       const stl_callback& callback);
+
+// Loads a binary stl file by streaming it through an ifstream and welding
+// every batch into a mesh.
+mesh parse_stl_stream(const std::string& file);
+
+namespace detail {
+
+// Copies the corner positions of count consecutive 50 byte stl records
+// into corners (3 * count entries), skipping normals and attributes.
+void decode_stl_records(const char* records, std::size_t count,
+                        glm::vec3* corners);
+}
 
 namespace detail {
 template <typename T>
@@ -0,0 +1,284 @@
+#include "mesh_cache.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "simplify.hpp"
+
+namespace glrfw {
+
+namespace {
+
+const char cache_magic[8] = {'G', 'L', 'R', 'F', 'W', 'M', 'S', 'H'};
+
+// 2: triangles are stored in vertex cache order
+// 3: vertices are stored in fetch order
+const uint32_t cache_version = 3;
+
+struct cache_header {
+    char magic[8];
+
+    uint32_t version;
+
+    uint32_t reserved;
+
+    uint64_t source_hash;
+
+    uint64_t num_vertices;
+
+    uint64_t num_triangles;
+};
+
+static_assert(sizeof(cache_header) == 40, "cache header must be packed");
+
+static_assert(sizeof(glm::ivec3) == 3 * sizeof(int),
+              "glm::ivec3 must be tightly packed");
+
+cache_header read_header(const mapped_file& file)
+{
+    cache_header header;
+    THROW_IF(file.size() < sizeof(cache_header),
+             error_type::invalid_file_format);
+    std::memcpy(&header, file.data(), sizeof(cache_header));
+    THROW_IF(std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0,
+             error_type::invalid_file_format);
+    THROW_IF(header.version != cache_version, error_type::invalid_file_format);
+    THROW_IF(file.size() != sizeof(cache_header) +
+                                header.num_vertices * 2 * sizeof(glm::vec3) +
+                                header.num_triangles *
+                                    (sizeof(glm::ivec3) + sizeof(glm::vec3)),
+             error_type::invalid_file_format);
+    return header;
+}
+
+const uint64_t prime1 = UINT64_C(11400714785074694791);
+
+const uint64_t prime2 = UINT64_C(14029467366897019727);
+
+const uint64_t prime3 = UINT64_C(1609587929392839161);
+
+const uint64_t prime4 = UINT64_C(9650029242287828579);
+
+const uint64_t prime5 = UINT64_C(2870177450012600261);
+
+uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t read64(const char* data)
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    return rotl(acc + input * prime2, 31) * prime1;
+}
+
+uint64_t hash_merge(uint64_t acc, uint64_t value)
+{
+    return (acc ^ hash_round(0, value)) * prime1 + prime4;
+}
+
+} // end of anonymous namespace
+
+namespace detail {
+
+uint64_t hash_bytes(const char* data, std::size_t size, uint64_t seed)
+{
+    const char* end = data + size;
+    uint64_t hash;
+    if (size >= 32) {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+        for (; data + 32 <= end; data += 32) {
+            v1 = hash_round(v1, read64(data));
+            v2 = hash_round(v2, read64(data + 8));
+            v3 = hash_round(v3, read64(data + 16));
+            v4 = hash_round(v4, read64(data + 24));
+        }
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = hash_merge(hash, v1);
+        hash = hash_merge(hash, v2);
+        hash = hash_merge(hash, v3);
+        hash = hash_merge(hash, v4);
+    }
+    else {
+        hash = seed + prime5;
+    }
+    hash += size;
+    for (; data + 8 <= end; data += 8) {
+        hash = rotl(hash ^ hash_round(0, read64(data)), 27) * prime1 + prime4;
+    }
+    if (data + 4 <= end) {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        hash = rotl(hash ^ (value * prime1), 23) * prime2 + prime3;
+        data += 4;
+    }
+    for (; data < end; ++data) {
+        hash = rotl(hash ^ (static_cast<unsigned char>(*data) * prime5), 11) *
+               prime1;
+    }
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+}
+
+mesh_cache::mesh_cache(const std::string& file)
+    : file_(file), num_vertices_(0), num_triangles_(0)
+{
+    cache_header header = read_header(file_);
+    num_vertices_ = static_cast<std::size_t>(header.num_vertices);
+    num_triangles_ = static_cast<std::size_t>(header.num_triangles);
+}
+
+uint64_t mesh_cache::source_hash() const
+{
+    cache_header header;
+    std::memcpy(&header, file_.data(), sizeof(cache_header));
+    return header.source_hash;
+}
+
+std::size_t mesh_cache::num_vertices() const
+{
+    return num_vertices_;
+}
+
+std::size_t mesh_cache::num_triangles() const
+{
+    return num_triangles_;
+}
+
+const char* mesh_cache::section(std::size_t offset) const
+{
+    return file_.data() + sizeof(cache_header) + offset;
+}
+
+const glm::vec3* mesh_cache::vertices() const
+{
+    return reinterpret_cast<const glm::vec3*>(section(0));
+}
+
+const glm::vec3* mesh_cache::vertex_normals() const
+{
+    return reinterpret_cast<const glm::vec3*>(
+        section(num_vertices_ * sizeof(glm::vec3)));
+}
+
+const glm::ivec3* mesh_cache::triangles() const
+{
+    return reinterpret_cast<const glm::ivec3*>(
+        section(num_vertices_ * 2 * sizeof(glm::vec3)));
+}
+
+const glm::vec3* mesh_cache::face_normals() const
+{
+    return reinterpret_cast<const glm::vec3*>(
+        section(num_vertices_ * 2 * sizeof(glm::vec3) +
+                num_triangles_ * sizeof(glm::ivec3)));
+}
+
+void save_mesh_cache(const mesh& mesh, uint64_t source_hash,
+                     const std::string& file)
+{
+    THROW_IF(mesh.vertex_normals.size() != mesh.vertices.size(),
+             error_type::invalid_file_format);
+    THROW_IF(mesh.face_normals.size() != mesh.triangles.size(),
+             error_type::invalid_file_format);
+    cache_header header;
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.reserved = 0;
+    header.source_hash = source_hash;
+    header.num_vertices = mesh.vertices.size();
+    header.num_triangles = mesh.triangles.size();
+
+    // write next to the target and rename, so a reader never maps a
+    // partially written cache
+    std::string temp = file + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::out | std::ios::binary);
+        THROW_IF(!out.is_open(), error_type::file_not_found);
+        auto write = [&out](const void* data, std::size_t size) {
+            out.write(static_cast<const char*>(data),
+                      static_cast<std::streamsize>(size));
+        };
+        write(&header, sizeof(header));
+        write(mesh.vertices.data(), mesh.vertices.size() * sizeof(glm::vec3));
+        write(mesh.vertex_normals.data(),
+              mesh.vertex_normals.size() * sizeof(glm::vec3));
+        write(mesh.triangles.data(),
+              mesh.triangles.size() * sizeof(glm::ivec3));
+        write(mesh.face_normals.data(),
+              mesh.face_normals.size() * sizeof(glm::vec3));
+        THROW_IF(!out, error_type::file_not_found);
+    }
+    std::remove(file.c_str());
+    THROW_IF(std::rename(temp.c_str(), file.c_str()) != 0,
+             error_type::file_not_found);
+}
+
+uint64_t hash_file(const std::string& file)
+{
+    mapped_file data(file);
+    return detail::hash_bytes(data.data(), data.size());
+}
+
+mesh_cache load_cached_stl(const std::string& stl_file,
+                           const std::string& cache_file, float lod_ratio,
+                           float weld_epsilon,
+                           const std::function<void(const mesh&)>& parsed)
+{
+    // a cache built with another ratio or epsilon is stale as well
+    auto mix = [](uint64_t hash, float setting) {
+        char key[sizeof(hash) + sizeof(setting)];
+        std::memcpy(key, &hash, sizeof(hash));
+        std::memcpy(key + sizeof(hash), &setting, sizeof(setting));
+        return detail::hash_bytes(key, sizeof(key));
+    };
+    uint64_t hash = hash_file(stl_file);
+    if (lod_ratio < 1.0f) {
+        hash = mix(hash, lod_ratio);
+    }
+    if (weld_epsilon > 0.0f) {
+        hash = mix(hash, weld_epsilon);
+    }
+    try {
+        mesh_cache cache(cache_file);
+        if (cache.source_hash() == hash) {
+            return cache;
+        }
+    }
+    catch (const gl_error&) {
+        // missing or unreadable cache, rebuild it below
+    }
+    mesh mesh = parse_stl(stl_file, 0);
+    mesh.merge_vertices(weld_epsilon);
+    if (parsed) {
+        parsed(mesh);
+    }
+    if (lod_ratio < 1.0f) {
+        mesh = simplify(mesh, static_cast<std::size_t>(
+                                  lod_ratio *
+                                  static_cast<float>(mesh.triangles.size())));
+    }
+    // the cache is only rebuilt when the stl changes, report what the
+    // reordering gained for it
+    std::pair<float, float> acmr = mesh.optimize_vertex_cache();
+    std::cout << "ACMR " << cache_file << ": " << acmr.first << " -> "
+              << acmr.second << std::endl;
+    mesh.reorder_vertices();
+    save_mesh_cache(mesh, hash, cache_file);
+    return mesh_cache(cache_file);
+}
+
+} // end namespace glrfw
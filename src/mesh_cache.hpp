@@ -0,0 +1,83 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+
+namespace glrfw {
+
+// Binary cache of a welded mesh. The file starts with a header followed by
+// the vertices, vertex normals, triangles and face normals as tightly
+// packed arrays, in the same layout that is uploaded to the gpu.
+class mesh_cache {
+public:
+    // Maps a cache file. Throws if the file is not a valid cache.
+    mesh_cache(const std::string& file);
+
+    mesh_cache(const mesh_cache&) = delete;
+
+    mesh_cache& operator=(const mesh_cache&) = delete;
+
+    mesh_cache(mesh_cache&&) = default;
+
+    mesh_cache& operator=(mesh_cache&&) = default;
+
+    // Content hash of the file the cache was built from.
+    uint64_t source_hash() const;
+
+    std::size_t num_vertices() const;
+
+    std::size_t num_triangles() const;
+
+    const glm::vec3* vertices() const;
+
+    const glm::vec3* vertex_normals() const;
+
+    const glm::ivec3* triangles() const;
+
+    const glm::vec3* face_normals() const;
+
+private:
+    const char* section(std::size_t offset) const;
+
+    mapped_file file_;
+
+    std::size_t num_vertices_;
+
+    std::size_t num_triangles_;
+};
+
+// Writes the vertices, normals and triangles of mesh to a cache file keyed
+// by source_hash.
+void save_mesh_cache(const mesh& mesh, uint64_t source_hash,
+                     const std::string& file);
+
+// Content hash of a whole file.
+uint64_t hash_file(const std::string& file);
+
+// Returns the cached mesh for stl_file. The stl file is only parsed, and the
+// cache rewritten, if cache_file is missing or was built from different
+// content. Cached triangles are in vertex cache order and vertices in the
+// order the triangles first use them. With weld_epsilon above 0 vertices
+// within that distance are merged with mesh::merge_vertices first. With
+// lod_ratio below 1 the mesh is then simplified to that fraction of its
+// triangles before it is cached. If the cache is rebuilt, parsed is called
+// with the welded mesh before the slower passes run, e.g. to show a
+// preview built with cluster_vertices.
+mesh_cache load_cached_stl(
+    const std::string& stl_file, const std::string& cache_file,
+    float lod_ratio = 1.0f, float weld_epsilon = 0.0f,
+    const std::function<void(const mesh&)>& parsed = nullptr);
+
+namespace detail {
+
+// 64 bit xxHash of size bytes.
+uint64_t hash_bytes(const char* data, std::size_t size, uint64_t seed = 0);
+}
+
+} // end namespace glrfw
+
+#endif
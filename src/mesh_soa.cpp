@@ -0,0 +1,114 @@
+#include "mesh_soa.hpp"
+#include "kernels.hpp"
+
+namespace glrfw {
+
+soa_vec3::soa_vec3() : x(), y(), z()
+{
+}
+
+soa_vec3::soa_vec3(std::size_t size) : x(size), y(size), z(size)
+{
+}
+
+soa_vec3::soa_vec3(const glm::vec3* data, std::size_t count)
+    : x(count), y(count), z(count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        x[i] = data[i].x;
+        y[i] = data[i].y;
+        z[i] = data[i].z;
+    }
+}
+
+std::size_t soa_vec3::size() const
+{
+    return x.size();
+}
+
+void soa_vec3::resize(std::size_t size)
+{
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+}
+
+glm::vec3 soa_vec3::get(std::size_t i) const
+{
+    return glm::vec3(x[i], y[i], z[i]);
+}
+
+void soa_vec3::set(std::size_t i, const glm::vec3& value)
+{
+    x[i] = value.x;
+    y[i] = value.y;
+    z[i] = value.z;
+}
+
+void soa_vec3::interleave(glm::vec3* out) const
+{
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        out[i] = glm::vec3(x[i], y[i], z[i]);
+    }
+}
+
+mesh_soa::mesh_soa()
+    : vertices(), vertex_normals(), face_normals(), triangles()
+{
+}
+
+mesh_soa::mesh_soa(const mesh& mesh)
+    : vertices(mesh.vertices.data(), mesh.vertices.size()),
+      vertex_normals(mesh.vertex_normals.data(), mesh.vertex_normals.size()),
+      face_normals(mesh.face_normals.data(), mesh.face_normals.size()),
+      triangles(mesh.triangles)
+{
+}
+
+void mesh_soa::calculate_normals()
+{
+    std::vector<float> areas(triangles.size());
+    face_normals.resize(triangles.size());
+    compute_face_normals(vertices.x.data(), vertices.y.data(),
+                         vertices.z.data(), triangles.data(),
+                         triangles.size(), face_normals.x.data(),
+                         face_normals.y.data(), face_normals.z.data(),
+                         areas.data());
+
+    vertex_normals = soa_vec3(vertices.size());
+    for (std::size_t i = 0; i < triangles.size(); ++i) {
+        // degenerate triangles have no normal to contribute
+        if (!(areas[i] > 0.0f)) {
+            continue;
+        }
+        glm::vec3 weighted = face_normals.get(i) * areas[i];
+        for (int k = 0; k < 3; ++k) {
+            std::size_t v = static_cast<std::size_t>(triangles[i][k]);
+            vertex_normals.x[v] += weighted.x;
+            vertex_normals.y[v] += weighted.y;
+            vertex_normals.z[v] += weighted.z;
+        }
+    }
+    normalize_vectors(vertex_normals.x.data(), vertex_normals.y.data(),
+                      vertex_normals.z.data(), vertex_normals.size());
+}
+
+void mesh_soa::centralize()
+{
+    if (vertices.size() == 0) {
+        return;
+    }
+    glm::vec3 center = sum_vectors(vertices.x.data(), vertices.y.data(),
+                                   vertices.z.data(), vertices.size()) /
+                       static_cast<float>(vertices.size());
+    translate_vectors(vertices.x.data(), vertices.y.data(), vertices.z.data(),
+                      vertices.size(), -center);
+}
+
+std::pair<glm::vec3, glm::vec3> mesh_soa::bounds() const
+{
+    return bounds_of(vertices.x.data(), vertices.y.data(), vertices.z.data(),
+                     vertices.size());
+}
+
+} // end namespace glrfw
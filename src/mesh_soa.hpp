@@ -0,0 +1,123 @@
+#ifndef MESH_SOA_HPP
+#define MESH_SOA_HPP
+
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#include "mesh.hpp"
+
+namespace glrfw {
+
+// Allocator returning memory aligned for wide simd loads.
+template <typename T> struct aligned_allocator {
+    typedef T value_type;
+
+    static const std::size_t alignment = 32;
+
+    aligned_allocator()
+    {
+    }
+
+    template <typename U> aligned_allocator(const aligned_allocator<U>&)
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        void* ptr = nullptr;
+#ifdef _WIN32
+        ptr = _aligned_malloc(count * sizeof(T), alignment);
+#else
+        if (posix_memalign(&ptr, alignment, count * sizeof(T)) != 0) {
+            ptr = nullptr;
+        }
+#endif
+        if (ptr == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+
+    void deallocate(T* ptr, std::size_t)
+    {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&)
+{
+    return false;
+}
+
+typedef std::vector<float, aligned_allocator<float>> aligned_floats;
+
+// Vectors stored as separate, aligned x, y and z arrays.
+struct soa_vec3 {
+    soa_vec3();
+
+    explicit soa_vec3(std::size_t size);
+
+    // Copies count interleaved vectors.
+    soa_vec3(const glm::vec3* data, std::size_t count);
+
+    std::size_t size() const;
+
+    void resize(std::size_t size);
+
+    glm::vec3 get(std::size_t i) const;
+
+    void set(std::size_t i, const glm::vec3& value);
+
+    // Writes the vectors back in interleaved layout, e.g. into a mapped
+    // vertex buffer, without an intermediate copy.
+    void interleave(glm::vec3* out) const;
+
+    aligned_floats x;
+
+    aligned_floats y;
+
+    aligned_floats z;
+};
+
+// Structure of arrays copy of a mesh, used for vectorized processing of
+// positions and normals.
+class mesh_soa {
+public:
+    mesh_soa();
+
+    explicit mesh_soa(const mesh& mesh);
+
+    // Same as mesh::calculate_normals on the soa arrays.
+    void calculate_normals();
+
+    // Moves the centroid of the vertices to the origin.
+    void centralize();
+
+    // Smallest and largest coordinates of the vertices, an empty box from
+    // +infinity to -infinity when there are none.
+    std::pair<glm::vec3, glm::vec3> bounds() const;
+
+    soa_vec3 vertices;
+
+    soa_vec3 vertex_normals;
+
+    soa_vec3 face_normals;
+
+    std::vector<glm::ivec3> triangles;
+};
+
+} // end namespace glrfw
+
+#endif
@@ -0,0 +1,202 @@
+#include "optimize.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace glrfw {
+
+namespace {
+
+// Triangles of every vertex in compressed rows, like mesh::build_neighbors.
+void vertex_triangles(const glm::ivec3* triangles, std::size_t num_tri,
+                      std::size_t num_vertices, std::vector<int>& offsets,
+                      std::vector<int>& faces)
+{
+    offsets.assign(num_vertices + 1, 0);
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            ++offsets[static_cast<std::size_t>(triangles[i][k]) + 1];
+        }
+    }
+    for (std::size_t i = 1; i < offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    faces.resize(3 * num_tri);
+    std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            int& pos = cursor[static_cast<std::size_t>(triangles[i][k])];
+            faces[static_cast<std::size_t>(pos++)] = static_cast<int>(i);
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+float acmr(const glm::ivec3* triangles, std::size_t num_tri,
+           std::size_t num_vertices, int cache_size)
+{
+    if (num_tri == 0) {
+        return 0.0f;
+    }
+    // a vertex is cached if fewer than cache_size misses happened since
+    // it was loaded
+    std::vector<long> loaded(num_vertices, -cache_size);
+    long misses = 0;
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            long& time = loaded[static_cast<std::size_t>(triangles[i][k])];
+            if (misses - time >= cache_size) {
+                time = ++misses;
+            }
+        }
+    }
+    return static_cast<float>(misses) / static_cast<float>(num_tri);
+}
+
+std::vector<int> tipsify(const glm::ivec3* triangles, std::size_t num_tri,
+                         std::size_t num_vertices, int cache_size)
+{
+    std::vector<int> offsets;
+    std::vector<int> faces;
+    vertex_triangles(triangles, num_tri, num_vertices, offsets, faces);
+
+    // live triangles and cache time stamp of every vertex
+    std::vector<int> live(num_vertices);
+    for (std::size_t v = 0; v < num_vertices; ++v) {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<int> stamp(num_vertices, 0);
+    std::vector<char> emitted(num_tri, 0);
+    std::vector<int> dead_end;
+    std::vector<int> candidates;
+    std::vector<int> order;
+    order.reserve(num_tri);
+
+    int time = cache_size + 1;
+    std::size_t cursor = 0;
+    int fan = num_vertices == 0 ? -1 : 0;
+    while (fan != -1) {
+        candidates.clear();
+        for (int i = offsets[fan]; i < offsets[fan + 1]; ++i) {
+            int tri = faces[static_cast<std::size_t>(i)];
+            if (emitted[static_cast<std::size_t>(tri)]) {
+                continue;
+            }
+            emitted[static_cast<std::size_t>(tri)] = 1;
+            order.push_back(tri);
+            for (int k = 0; k < 3; ++k) {
+                int v = triangles[tri][k];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[static_cast<std::size_t>(v)];
+                if (time - stamp[static_cast<std::size_t>(v)] > cache_size) {
+                    stamp[static_cast<std::size_t>(v)] = time++;
+                }
+            }
+        }
+
+        // prefer the candidate that stays in the cache for the longest
+        // while its remaining triangles are emitted
+        fan = -1;
+        int best = -1;
+        for (int v : candidates) {
+            std::size_t index = static_cast<std::size_t>(v);
+            if (live[index] == 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - stamp[index] + 2 * live[index] <= cache_size) {
+                priority = time - stamp[index];
+            }
+            if (priority > best) {
+                best = priority;
+                fan = v;
+            }
+        }
+        // otherwise fall back to recently used vertices, then to the
+        // next vertex in index order with triangles left
+        while (fan == -1 && !dead_end.empty()) {
+            int v = dead_end.back();
+            dead_end.pop_back();
+            if (live[static_cast<std::size_t>(v)] > 0) {
+                fan = v;
+            }
+        }
+        while (fan == -1 && cursor < num_vertices) {
+            if (live[cursor] > 0) {
+                fan = static_cast<int>(cursor);
+            }
+            ++cursor;
+        }
+    }
+    return order;
+}
+
+std::vector<int> fetch_order(const glm::ivec3* triangles, std::size_t num_tri,
+                             std::size_t num_vertices)
+{
+    std::vector<int> remap(num_vertices, -1);
+    int next = 0;
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        for (int k = 0; k < 3; ++k) {
+            int& index = remap[static_cast<std::size_t>(triangles[i][k])];
+            if (index == -1) {
+                index = next++;
+            }
+        }
+    }
+    for (int& index : remap) {
+        if (index == -1) {
+            index = next++;
+        }
+    }
+    return remap;
+}
+
+std::vector<int> morton_order(const glm::vec3* vertices,
+                              std::size_t num_vertices)
+{
+    if (num_vertices == 0) {
+        return std::vector<int>();
+    }
+    glm::vec3 lower = vertices[0];
+    glm::vec3 upper = vertices[0];
+    for (std::size_t i = 1; i < num_vertices; ++i) {
+        lower = glm::min(lower, vertices[i]);
+        upper = glm::max(upper, vertices[i]);
+    }
+    glm::vec3 scale =
+        1023.0f / glm::max(upper - lower, glm::vec3(1e-30f, 1e-30f, 1e-30f));
+
+    std::vector<std::pair<uint32_t, int>> keys(num_vertices);
+    for (std::size_t i = 0; i < num_vertices; ++i) {
+        glm::uvec3 cell((vertices[i] - lower) * scale);
+        keys[i] = std::make_pair(detail::morton_code(cell.x, cell.y, cell.z),
+                                 static_cast<int>(i));
+    }
+    // ties keep their index order
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> remap(num_vertices);
+    for (std::size_t i = 0; i < num_vertices; ++i) {
+        remap[static_cast<std::size_t>(keys[i].second)] = static_cast<int>(i);
+    }
+    return remap;
+}
+
+namespace detail {
+
+uint32_t morton_code(uint32_t x, uint32_t y, uint32_t z)
+{
+    auto spread = [](uint32_t value) {
+        value &= 0x3ff;
+        value = (value | (value << 16)) & 0x030000ff;
+        value = (value | (value << 8)) & 0x0300f00f;
+        value = (value | (value << 4)) & 0x030c30c3;
+        value = (value | (value << 2)) & 0x09249249;
+        return value;
+    };
+    return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+}
+
+} // end namespace glrfw
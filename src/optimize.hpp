@@ -0,0 +1,43 @@
+#ifndef OPTIMIZE_HPP
+#define OPTIMIZE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "error.hpp"
+
+namespace glrfw {
+
+// Average number of vertex shader runs per triangle when drawing
+// triangles in order through a fifo post-transform cache of cache_size
+// entries. Lies between about 0.5 for an ideal order and 3.
+float acmr(const glm::ivec3* triangles, std::size_t num_tri,
+           std::size_t num_vertices, int cache_size = 16);
+
+// Orders triangles for the post-transform vertex cache with Tipsify
+// (Sander, Nehab and Barczak 2007), in time linear in num_tri. Returns the
+// new order as indices into triangles.
+std::vector<int> tipsify(const glm::ivec3* triangles, std::size_t num_tri,
+                         std::size_t num_vertices, int cache_size = 16);
+
+// Numbers vertices in the order triangles first reference them, so the
+// vertex buffer is read front to back. Returns the new index of every
+// vertex; unreferenced vertices go last.
+std::vector<int> fetch_order(const glm::ivec3* triangles, std::size_t num_tri,
+                             std::size_t num_vertices);
+
+// Numbers vertices along a Morton curve through their bounding box with
+// 10 bits per axis, so vertices close in space are close in memory.
+// Returns the new index of every vertex.
+std::vector<int> morton_order(const glm::vec3* vertices,
+                              std::size_t num_vertices);
+
+namespace detail {
+
+// Interleaves the lower 10 bits of x, y and z into a 30 bit Morton code.
+uint32_t morton_code(uint32_t x, uint32_t y, uint32_t z);
+}
+
+} // end namespace glrfw
+
+#endif
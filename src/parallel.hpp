@@ -0,0 +1,48 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace glrfw {
+
+namespace detail {
+
+// Smallest number of items worth handing to a worker thread.
+const std::size_t min_chunk_size = 16384;
+
+// Number of threads to use for count items, 0 meaning all hardware threads.
+inline unsigned int thread_count(unsigned int num_threads, std::size_t count)
+{
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return static_cast<unsigned int>(std::min<std::size_t>(
+        num_threads, std::max<std::size_t>(1, count / min_chunk_size)));
+}
+
+// Splits [0, count) into num_threads contiguous ranges and calls
+// func(first, last) for each of them on its own thread.
+template <typename F>
+void parallel_ranges(unsigned int num_threads, std::size_t count, F func)
+{
+    if (num_threads <= 1) {
+        func(std::size_t(0), count);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < num_threads; ++i) {
+        workers.emplace_back(func, count * i / num_threads,
+                             count * (i + 1) / num_threads);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+}
+
+} // end namespace glrfw
+
+#endif
@@ -0,0 +1,387 @@
+#include "rasterizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include "parallel.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define GLRFW_USE_SSE
+#endif
+
+namespace glrfw {
+
+namespace {
+
+// Smallest depth difference of a 24 bit fixed point depth buffer, the unit
+// of glPolygonOffset.
+const float depth_resolution = 1.0f / 16777216.0f;
+
+} // end of anonymous namespace
+
+const int depth_rasterizer::tile_size;
+
+struct depth_rasterizer::setup {
+    setup()
+        : x0(0), y0(0), z0(0), dzdx(0), dzdy(0), offset(0), a(), b(), ex(),
+          ey(), owned(), min_x(0), min_y(0), max_x(0), max_y(0)
+    {
+    }
+
+    // window space position of the first corner and the depth plane
+    float x0;
+
+    float y0;
+
+    float z0;
+
+    float dzdx;
+
+    float dzdy;
+
+    float offset;
+
+    // edge functions a * (x - ex) + b * (y - ey), positive inside
+    float a[3];
+
+    float b[3];
+
+    float ex[3];
+
+    float ey[3];
+
+    // whether pixel centers exactly on the edge belong to the triangle,
+    // true for exactly one of two triangles sharing the edge
+    bool owned[3];
+
+    // covered pixels, inclusive
+    int min_x;
+
+    int min_y;
+
+    int max_x;
+
+    int max_y;
+};
+
+struct depth_rasterizer::batch {
+    batch() : triangles(), bins()
+    {
+    }
+
+    std::vector<setup> triangles;
+
+    // indices into triangles for every tile
+    std::vector<std::vector<int>> bins;
+};
+
+depth_rasterizer::depth_rasterizer(int width, int height)
+    : width_(width), height_(height), stride_((width + 3) / 4 * 4),
+      offset_factor_(0.0f), offset_units_(0.0f),
+      depth_(static_cast<std::size_t>(stride_) *
+                 static_cast<std::size_t>(height),
+             1.0f)
+{
+}
+
+int depth_rasterizer::width() const
+{
+    return width_;
+}
+
+int depth_rasterizer::height() const
+{
+    return height_;
+}
+
+void depth_rasterizer::clear(float value)
+{
+    std::fill(depth_.begin(), depth_.end(), value);
+}
+
+void depth_rasterizer::polygon_offset(float factor, float units)
+{
+    offset_factor_ = factor;
+    offset_units_ = units;
+}
+
+void depth_rasterizer::draw(const glm::vec3* vertices,
+                            std::size_t num_vertices,
+                            const glm::ivec3* triangles, std::size_t num_tri,
+                            const glm::mat4& matrix, unsigned int num_threads)
+{
+    std::vector<glm::vec4> clip(num_vertices);
+    detail::parallel_ranges(detail::thread_count(num_threads, num_vertices),
+                            num_vertices,
+                            [&](std::size_t first, std::size_t last) {
+                                for (std::size_t i = first; i < last; ++i) {
+                                    clip[i] =
+                                        matrix * glm::vec4(vertices[i], 1.0f);
+                                }
+                            });
+
+    // set up and bin contiguous ranges of triangles, keeping their order
+    unsigned int workers = detail::thread_count(num_threads, num_tri);
+    std::vector<batch> batches(workers);
+    std::size_t num_tiles = static_cast<std::size_t>(tiles_x()) *
+                            static_cast<std::size_t>(tiles_y());
+    detail::parallel_ranges(
+        workers, workers, [&](std::size_t worker, std::size_t) {
+            batch& out = batches[worker];
+            out.bins.resize(num_tiles);
+            std::size_t first = num_tri * worker / workers;
+            std::size_t last = num_tri * (worker + 1) / workers;
+            for (std::size_t i = first; i < last; ++i) {
+                glm::vec4 corners[3];
+                for (int k = 0; k < 3; ++k) {
+                    corners[k] = clip[static_cast<std::size_t>(
+                        triangles[i][k])];
+                }
+                add_triangle(corners, out);
+            }
+        });
+
+    // the tiles cover disjoint pixels, so they need no synchronization
+    unsigned int tile_workers = detail::thread_count(
+        num_threads, static_cast<std::size_t>(width_) *
+                         static_cast<std::size_t>(height_));
+    detail::parallel_ranges(tile_workers, num_tiles,
+                            [&](std::size_t first, std::size_t last) {
+                                for (std::size_t tile = first; tile < last;
+                                     ++tile) {
+                                    rasterize_tile(static_cast<int>(tile),
+                                                   batches);
+                                }
+                            });
+}
+
+void depth_rasterizer::draw(const mesh& mesh, const glm::mat4& matrix,
+                            unsigned int num_threads)
+{
+    if (mesh.vertices.empty() || mesh.triangles.empty()) {
+        return;
+    }
+    draw(&mesh.vertices[0], mesh.vertices.size(), &mesh.triangles[0],
+         mesh.triangles.size(), matrix, num_threads);
+}
+
+float depth_rasterizer::depth(int x, int y) const
+{
+    return depth_[static_cast<std::size_t>(y) *
+                      static_cast<std::size_t>(stride_) +
+                  static_cast<std::size_t>(x)];
+}
+
+std::vector<float> depth_rasterizer::depths() const
+{
+    std::vector<float> out;
+    out.reserve(static_cast<std::size_t>(width_) *
+                static_cast<std::size_t>(height_));
+    for (int y = 0; y < height_; ++y) {
+        auto row = depth_.begin() + static_cast<std::ptrdiff_t>(y) * stride_;
+        out.insert(out.end(), row, row + width_);
+    }
+    return out;
+}
+
+int depth_rasterizer::tiles_x() const
+{
+    return (width_ + tile_size - 1) / tile_size;
+}
+
+int depth_rasterizer::tiles_y() const
+{
+    return (height_ + tile_size - 1) / tile_size;
+}
+
+void depth_rasterizer::add_triangle(const glm::vec4* corners,
+                                    batch& out) const
+{
+    // clip against the near plane z = -w, the other planes are left to the
+    // bounds of the tiles and the depth test
+    glm::vec4 polygon[4];
+    int size = 0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4& current = corners[i];
+        const glm::vec4& next = corners[(i + 1) % 3];
+        float d_current = current.z + current.w;
+        float d_next = next.z + next.w;
+        if (d_current >= 0.0f) {
+            polygon[size++] = current;
+        }
+        if ((d_current >= 0.0f) != (d_next >= 0.0f)) {
+            float t = d_current / (d_current - d_next);
+            polygon[size++] = current + t * (next - current);
+        }
+    }
+
+    glm::vec3 window[4];
+    for (int i = 0; i < size; ++i) {
+        glm::vec3 ndc = glm::vec3(polygon[i]) / polygon[i].w;
+        window[i] = glm::vec3(
+            (ndc.x + 1.0f) * 0.5f * static_cast<float>(width_),
+            (ndc.y + 1.0f) * 0.5f * static_cast<float>(height_),
+            (ndc.z + 1.0f) * 0.5f);
+    }
+
+    for (int fan = 1; fan + 1 < size; ++fan) {
+        glm::vec3 v[3] = {window[0], window[fan], window[fan + 1]};
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+                     (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (!(std::abs(area) > 0.0f)) {
+            continue;
+        }
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+        glm::vec3 lower = glm::min(glm::min(v[0], v[1]), v[2]);
+        glm::vec3 upper = glm::max(glm::max(v[0], v[1]), v[2]);
+        setup tri;
+        // pixels whose centers lie in the bounds
+        tri.min_x = std::max(0, static_cast<int>(std::ceil(lower.x - 0.5f)));
+        tri.min_y = std::max(0, static_cast<int>(std::ceil(lower.y - 0.5f)));
+        tri.max_x = std::min(width_ - 1,
+                             static_cast<int>(std::floor(upper.x - 0.5f)));
+        tri.max_y = std::min(height_ - 1,
+                             static_cast<int>(std::floor(upper.y - 0.5f)));
+        if (tri.min_x > tri.max_x || tri.min_y > tri.max_y) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            const glm::vec3& from = v[k];
+            const glm::vec3& to = v[(k + 1) % 3];
+            tri.a[k] = from.y - to.y;
+            tri.b[k] = to.x - from.x;
+            tri.ex[k] = from.x;
+            tri.ey[k] = from.y;
+            tri.owned[k] =
+                tri.a[k] > 0.0f || (!(tri.a[k] < 0.0f) && tri.b[k] < 0.0f);
+        }
+        glm::vec3 e1 = v[1] - v[0];
+        glm::vec3 e2 = v[2] - v[0];
+        tri.x0 = v[0].x;
+        tri.y0 = v[0].y;
+        tri.z0 = v[0].z;
+        tri.dzdx = (e1.z * e2.y - e2.z * e1.y) / area;
+        tri.dzdy = (e2.z * e1.x - e1.z * e2.x) / area;
+        tri.offset =
+            offset_factor_ * std::max(std::abs(tri.dzdx), std::abs(tri.dzdy)) +
+            offset_units_ * depth_resolution;
+
+        int index = static_cast<int>(out.triangles.size());
+        out.triangles.push_back(tri);
+        for (int ty = tri.min_y / tile_size; ty <= tri.max_y / tile_size;
+             ++ty) {
+            for (int tx = tri.min_x / tile_size; tx <= tri.max_x / tile_size;
+                 ++tx) {
+                out.bins[static_cast<std::size_t>(ty * tiles_x() + tx)]
+                    .push_back(index);
+            }
+        }
+    }
+}
+
+void depth_rasterizer::rasterize_tile(int tile,
+                                      const std::vector<batch>& batches)
+{
+    int tile_x = tile % tiles_x() * tile_size;
+    int tile_y = tile / tiles_x() * tile_size;
+    int tile_max_x = std::min(width_, tile_x + tile_size) - 1;
+    int tile_max_y = std::min(height_, tile_y + tile_size) - 1;
+    for (const batch& source : batches) {
+        for (int index : source.bins[static_cast<std::size_t>(tile)]) {
+            const setup& tri =
+                source.triangles[static_cast<std::size_t>(index)];
+            int min_x = std::max(tri.min_x, tile_x);
+            int max_x = std::min(tri.max_x, tile_max_x);
+            int min_y = std::max(tri.min_y, tile_y);
+            int max_y = std::min(tri.max_y, tile_max_y);
+            for (int y = min_y; y <= max_y; ++y) {
+                float py = static_cast<float>(y) + 0.5f;
+                float* row = &depth_[static_cast<std::size_t>(y) *
+                                     static_cast<std::size_t>(stride_)];
+                // per row parts of the edge functions and the depth
+                float row_edge[3];
+                for (int k = 0; k < 3; ++k) {
+                    row_edge[k] = tri.b[k] * (py - tri.ey[k]);
+                }
+                float row_z = tri.z0 + tri.dzdy * (py - tri.y0) + tri.offset;
+                int x = min_x;
+#ifdef GLRFW_USE_SSE
+                // groups of four pixels starting at a multiple of four, the
+                // padded rows keep the last group in bounds
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 one = _mm_set1_ps(1.0f);
+                const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                __m128 edge_a[3];
+                __m128 edge_x[3];
+                __m128 edge_row[3];
+                __m128 owned[3];
+                for (int k = 0; k < 3; ++k) {
+                    edge_a[k] = _mm_set1_ps(tri.a[k]);
+                    edge_x[k] = _mm_set1_ps(tri.ex[k]);
+                    edge_row[k] = _mm_set1_ps(row_edge[k]);
+                    owned[k] = _mm_castsi128_ps(
+                        _mm_set1_epi32(tri.owned[k] ? -1 : 0));
+                }
+                const __m128 dzdx = _mm_set1_ps(tri.dzdx);
+                const __m128 x0 = _mm_set1_ps(tri.x0);
+                const __m128 z_row = _mm_set1_ps(row_z);
+                const __m128i first = _mm_set1_epi32(min_x);
+                const __m128i last = _mm_set1_epi32(max_x);
+                for (int group = min_x & ~3; group <= max_x; group += 4) {
+                    __m128i index_x = _mm_add_epi32(_mm_set1_epi32(group),
+                                                    _mm_setr_epi32(0, 1, 2, 3));
+                    __m128 px = _mm_add_ps(
+                        _mm_set1_ps(static_cast<float>(group)), lane);
+                    // lanes inside [min_x, max_x]
+                    __m128 mask = _mm_castsi128_ps(_mm_andnot_si128(
+                        _mm_or_si128(_mm_cmplt_epi32(index_x, first),
+                                     _mm_cmpgt_epi32(index_x, last)),
+                        _mm_set1_epi32(-1)));
+                    for (int k = 0; k < 3; ++k) {
+                        __m128 edge = _mm_add_ps(
+                            _mm_mul_ps(edge_a[k], _mm_sub_ps(px, edge_x[k])),
+                            edge_row[k]);
+                        __m128 inside = _mm_or_ps(
+                            _mm_cmpgt_ps(edge, zero),
+                            _mm_and_ps(_mm_cmpeq_ps(edge, zero), owned[k]));
+                        mask = _mm_and_ps(mask, inside);
+                    }
+                    if (_mm_movemask_ps(mask) == 0) {
+                        continue;
+                    }
+                    __m128 z = _mm_add_ps(
+                        _mm_mul_ps(dzdx, _mm_sub_ps(px, x0)), z_row);
+                    z = _mm_min_ps(_mm_max_ps(z, zero), one);
+                    __m128 old = _mm_loadu_ps(row + group);
+                    mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old));
+                    _mm_storeu_ps(row + group,
+                                  _mm_or_ps(_mm_and_ps(mask, z),
+                                            _mm_andnot_ps(mask, old)));
+                }
+                x = max_x + 1;
+#endif
+                for (; x <= max_x; ++x) {
+                    float px = static_cast<float>(x) + 0.5f;
+                    bool inside = true;
+                    for (int k = 0; k < 3 && inside; ++k) {
+                        float edge = tri.a[k] * (px - tri.ex[k]) + row_edge[k];
+                        inside = edge > 0.0f ||
+                                 (tri.owned[k] && !(edge < 0.0f));
+                    }
+                    if (!inside) {
+                        continue;
+                    }
+                    float z = tri.dzdx * (px - tri.x0) + row_z;
+                    z = std::min(std::max(z, 0.0f), 1.0f);
+                    if (z < row[x]) {
+                        row[x] = z;
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // end namespace glrfw
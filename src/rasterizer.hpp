@@ -0,0 +1,87 @@
+#ifndef RASTERIZER_HPP
+#define RASTERIZER_HPP
+
+#include <cstddef>
+#include <vector>
+#include "mesh.hpp"
+
+namespace glrfw {
+
+// Depth only software rasterizer following the GL rules the shadow pass
+// relies on: triangles are clipped against the near plane, mapped with
+// the default viewport and depth range, offset like glPolygonOffset and
+// kept where they pass a GL_LESS depth test. Both windings are drawn.
+//
+// Triangles are binned into tiles of tile_size pixels which are then
+// rasterized in parallel, four pixels at a time with sse where available.
+// Every tile draws its triangles in submission order, so the result does
+// not depend on the number of threads.
+class depth_rasterizer {
+public:
+    depth_rasterizer(int width, int height);
+
+    int width() const;
+
+    int height() const;
+
+    // Sets every depth to value, like glClear with glClearDepth(value).
+    void clear(float value = 1.0f);
+
+    // Same as glPolygonOffset, units are taken in steps of the 24 bit depth
+    // buffer GL allocates for GL_DEPTH_COMPONENT textures. (0, 0) turns
+    // the offset off.
+    void polygon_offset(float factor, float units);
+
+    // Draws num_tri triangles indexing into vertices, transformed to clip
+    // space by matrix, for example projection * view * model. Uses
+    // num_threads threads, 0 meaning all hardware threads.
+    void draw(const glm::vec3* vertices, std::size_t num_vertices,
+              const glm::ivec3* triangles, std::size_t num_tri,
+              const glm::mat4& matrix, unsigned int num_threads = 1);
+
+    void draw(const mesh& mesh, const glm::mat4& matrix,
+              unsigned int num_threads = 1);
+
+    // Window space depth of pixel x, y with y = 0 at the bottom row, as
+    // read back from GL.
+    float depth(int x, int y) const;
+
+    // All depths row by row from the bottom, laid out like the result of
+    // glReadPixels or glGetTexImage with GL_DEPTH_COMPONENT and GL_FLOAT.
+    std::vector<float> depths() const;
+
+    // Width and height of a tile in pixels.
+    static const int tile_size = 64;
+
+private:
+    // a triangle prepared for rasterization
+    struct setup;
+
+    // triangles set up by one thread, binned into tiles
+    struct batch;
+
+    void add_triangle(const glm::vec4* corners, batch& out) const;
+
+    void rasterize_tile(int tile, const std::vector<batch>& batches);
+
+    int tiles_x() const;
+
+    int tiles_y() const;
+
+    int width_;
+
+    int height_;
+
+    // rows are padded to a multiple of four pixels
+    int stride_;
+
+    float offset_factor_;
+
+    float offset_units_;
+
+    std::vector<float> depth_;
+};
+
+} // end namespace glrfw
+
+#endif
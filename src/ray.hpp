@@ -0,0 +1,63 @@
+#ifndef RAY_HPP
+#define RAY_HPP
+
+#include <limits>
+#include "error.hpp"
+
+namespace glrfw {
+
+// Ray from origin along direction, hits are reported for t_min < t < t_max.
+// direction does not need to be normalized, t is measured in its length.
+struct ray {
+    ray(const glm::vec3& from, const glm::vec3& dir, float min_t = 0.0f,
+        float max_t = std::numeric_limits<float>::infinity())
+        : origin(from), direction(dir), t_min(min_t), t_max(max_t)
+    {
+    }
+
+    glm::vec3 origin;
+
+    glm::vec3 direction;
+
+    float t_min;
+
+    float t_max;
+};
+
+// Closest intersection found by bvh::closest_hit. triangle is -1 if the ray
+// missed, u and v are the barycentric coordinates of the hit point.
+struct ray_hit {
+    ray_hit()
+        : triangle(-1), t(std::numeric_limits<float>::infinity()), u(0), v(0)
+    {
+    }
+
+    int triangle;
+
+    float t;
+
+    float u;
+
+    float v;
+};
+
+// Closest triangle under a ray found by mesh::pick. triangle is -1 if the
+// ray missed. barycentric holds the weights of the three corners of the
+// triangle, which give position when applied to them.
+struct pick_result {
+    pick_result() : triangle(-1), t(0), barycentric(), position()
+    {
+    }
+
+    int triangle;
+
+    float t;
+
+    glm::vec3 barycentric;
+
+    glm::vec3 position;
+};
+
+} // end namespace glrfw
+
+#endif
@@ -0,0 +1,515 @@
+#include "simplify.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <unordered_set>
+#include "half_edge.hpp"
+#include "vertex_table.hpp"
+
+namespace glrfw {
+
+namespace {
+
+// Weight of the constraint planes along boundary edges, relative to the
+// area weighted planes of the triangles.
+const double boundary_weight = 1000.0;
+
+// Symmetric 4x4 matrix of a sum of squared plane distances.
+struct quadric {
+    quadric()
+        : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0)
+    {
+    }
+
+    // weight * (dot(normal, p) + d)^2
+    quadric(const glm::dvec3& normal, double d, double weight)
+        : a2(weight * normal.x * normal.x), ab(weight * normal.x * normal.y),
+          ac(weight * normal.x * normal.z), ad(weight * normal.x * d),
+          b2(weight * normal.y * normal.y), bc(weight * normal.y * normal.z),
+          bd(weight * normal.y * d), c2(weight * normal.z * normal.z),
+          cd(weight * normal.z * d), d2(weight * d * d)
+    {
+    }
+
+    quadric& operator+=(const quadric& other)
+    {
+        a2 += other.a2;
+        ab += other.ab;
+        ac += other.ac;
+        ad += other.ad;
+        b2 += other.b2;
+        bc += other.bc;
+        bd += other.bd;
+        c2 += other.c2;
+        cd += other.cd;
+        d2 += other.d2;
+        return *this;
+    }
+
+    double error(const glm::dvec3& p) const
+    {
+        return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z +
+               2 * ad * p.x + b2 * p.y * p.y + 2 * bc * p.y * p.z +
+               2 * bd * p.y + c2 * p.z * p.z + 2 * cd * p.z + d2;
+    }
+
+    // Position of least error, false if it is not well defined.
+    bool minimum(glm::dvec3& p) const
+    {
+        glm::dmat3 a(a2, ab, ac, ab, b2, bc, ac, bc, c2);
+        double det = glm::determinant(a);
+        double scale = a2 * b2 * c2;
+        if (!(std::abs(det) > 1e-9 * scale)) {
+            return false;
+        }
+        p = -(glm::inverse(a) * glm::dvec3(ad, bd, cd));
+        return true;
+    }
+
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+};
+
+struct collapse {
+    collapse() : cost(0), keep(0), remove(0), keep_stamp(0), remove_stamp(0)
+    {
+    }
+
+    bool operator>(const collapse& other) const
+    {
+        return cost > other.cost;
+    }
+
+    double cost;
+
+    int keep;
+
+    int remove;
+
+    unsigned int keep_stamp;
+
+    unsigned int remove_stamp;
+};
+
+class simplifier {
+public:
+    explicit simplifier(const mesh& source)
+        : positions_(source.vertices.begin(), source.vertices.end()),
+          triangles_(source.triangles), quadrics_(source.vertices.size()),
+          faces_(source.vertices.size()),
+          boundary_(source.vertices.size(), 0),
+          stamps_(source.vertices.size(), 0),
+          removed_(source.vertices.size(), 0),
+          dead_(source.triangles.size(), 0), queue_(),
+          live_(source.triangles.size()), ring_a_(), ring_b_()
+    {
+        for (std::size_t i = 0; i < triangles_.size(); ++i) {
+            const glm::ivec3& tri = triangles_[i];
+            glm::dvec3 a = positions_[tri.x];
+            glm::dvec3 cross = glm::cross(positions_[tri.y] - a,
+                                          positions_[tri.z] - a);
+            double length = glm::length(cross);
+            if (length > 0.0) {
+                glm::dvec3 normal = cross / length;
+                quadric plane(normal, -glm::dot(normal, a), 0.5 * length);
+                for (int k = 0; k < 3; ++k) {
+                    quadrics_[tri[k]] += plane;
+                }
+            }
+            for (int k = 0; k < 3; ++k) {
+                faces_[tri[k]].push_back(static_cast<int>(i));
+            }
+        }
+
+        half_edges edges(triangles_, positions_.size());
+        for (int edge = 0; edge < static_cast<int>(edges.size()); ++edge) {
+            if (edges.opposite(edge) == -1) {
+                add_boundary(edges.face(edge), edges.vertex(edge),
+                             edges.target(edge));
+            }
+        }
+        for (int edge = 0; edge < static_cast<int>(edges.size()); ++edge) {
+            if (edges.opposite(edge) < edge) {
+                push(edges.vertex(edge), edges.target(edge));
+            }
+        }
+    }
+
+    void run(std::size_t target)
+    {
+        while (live_ > target && !queue_.empty()) {
+            collapse top = queue_.top();
+            queue_.pop();
+            if (removed_[top.keep] || removed_[top.remove] ||
+                stamps_[top.keep] != top.keep_stamp ||
+                stamps_[top.remove] != top.remove_stamp) {
+                continue;
+            }
+            glm::dvec3 position;
+            if (!place(top.keep, top.remove, position) ||
+                !valid(top.keep, top.remove, position)) {
+                continue;
+            }
+            apply(top.keep, top.remove, position);
+        }
+    }
+
+    mesh result() const
+    {
+        mesh out;
+        std::vector<int> remap(positions_.size(), -1);
+        for (std::size_t i = 0; i < triangles_.size(); ++i) {
+            if (dead_[i]) {
+                continue;
+            }
+            glm::ivec3 tri;
+            for (int k = 0; k < 3; ++k) {
+                int& index = remap[static_cast<std::size_t>(triangles_[i][k])];
+                if (index == -1) {
+                    index = static_cast<int>(out.vertices.size());
+                    out.vertices.push_back(
+                        glm::vec3(positions_[triangles_[i][k]]));
+                }
+                tri[k] = index;
+            }
+            out.triangles.push_back(tri);
+        }
+        out.calculate_normals();
+        return out;
+    }
+
+private:
+    // Adds the plane through the edge from a to b perpendicular to face.
+    void add_boundary(int face, int a, int b)
+    {
+        const glm::ivec3& tri = triangles_[static_cast<std::size_t>(face)];
+        glm::dvec3 p = positions_[tri.x];
+        glm::dvec3 face_normal =
+            glm::cross(positions_[tri.y] - p, positions_[tri.z] - p);
+        glm::dvec3 edge = positions_[b] - positions_[a];
+        glm::dvec3 normal = glm::cross(edge, face_normal);
+        double length = glm::length(normal);
+        if (length > 0.0) {
+            normal /= length;
+            quadric plane(normal, -glm::dot(normal, positions_[a]),
+                          boundary_weight * glm::dot(edge, edge));
+            quadrics_[a] += plane;
+            quadrics_[b] += plane;
+        }
+        boundary_[a] = 1;
+        boundary_[b] = 1;
+    }
+
+    void push(int a, int b)
+    {
+        // a boundary vertex never moves onto the interior
+        if (boundary_[b] && !boundary_[a]) {
+            std::swap(a, b);
+        }
+        glm::dvec3 position;
+        if (!place(a, b, position)) {
+            return;
+        }
+        quadric sum = quadrics_[a];
+        sum += quadrics_[b];
+        collapse entry;
+        entry.cost = sum.error(position);
+        entry.keep = a;
+        entry.remove = b;
+        entry.keep_stamp = stamps_[a];
+        entry.remove_stamp = stamps_[b];
+        queue_.push(entry);
+    }
+
+    // Position of the merged vertex, false if the edge may not collapse.
+    bool place(int keep, int remove, glm::dvec3& position) const
+    {
+        if (boundary_[remove]) {
+            // only collapse along boundary edges, otherwise the boundary
+            // would be pinched together
+            if (!boundary_[keep] || !shares_boundary(keep, remove)) {
+                return false;
+            }
+        }
+        else if (boundary_[keep]) {
+            position = positions_[keep];
+            return true;
+        }
+        quadric sum = quadrics_[keep];
+        sum += quadrics_[remove];
+        glm::dvec3 candidates[4] = {positions_[keep], positions_[remove],
+                                    0.5 * (positions_[keep] +
+                                           positions_[remove]),
+                                    glm::dvec3()};
+        int count = sum.minimum(candidates[3]) ? 4 : 3;
+        position = candidates[0];
+        double best = sum.error(position);
+        for (int i = 1; i < count; ++i) {
+            double error = sum.error(candidates[i]);
+            if (error < best) {
+                best = error;
+                position = candidates[i];
+            }
+        }
+        return true;
+    }
+
+    // Whether a and b are joined by exactly one live triangle.
+    bool shares_boundary(int a, int b) const
+    {
+        int shared = 0;
+        for (int face : faces_[static_cast<std::size_t>(a)]) {
+            const glm::ivec3& tri = triangles_[static_cast<std::size_t>(face)];
+            if (!dead_[static_cast<std::size_t>(face)] &&
+                (tri.x == b || tri.y == b || tri.z == b)) {
+                ++shared;
+            }
+        }
+        return shared == 1;
+    }
+
+    void ring(int vertex, std::vector<int>& out) const
+    {
+        out.clear();
+        for (int face : faces_[static_cast<std::size_t>(vertex)]) {
+            if (dead_[static_cast<std::size_t>(face)]) {
+                continue;
+            }
+            const glm::ivec3& tri = triangles_[static_cast<std::size_t>(face)];
+            for (int k = 0; k < 3; ++k) {
+                if (tri[k] != vertex) {
+                    out.push_back(tri[k]);
+                }
+            }
+        }
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    bool valid(int keep, int remove, const glm::dvec3& position)
+    {
+        // link condition: the rings may only share the vertices opposite
+        // the collapsed edge, otherwise the result is not manifold
+        ring(keep, ring_a_);
+        ring(remove, ring_b_);
+        std::size_t common = 0;
+        for (int vertex : ring_a_) {
+            common += std::binary_search(ring_b_.begin(), ring_b_.end(), vertex);
+        }
+        std::size_t shared = 0;
+        for (int face : faces_[static_cast<std::size_t>(keep)]) {
+            const glm::ivec3& tri = triangles_[static_cast<std::size_t>(face)];
+            shared += !dead_[static_cast<std::size_t>(face)] &&
+                      (tri.x == remove || tri.y == remove || tri.z == remove);
+        }
+        if (common != shared) {
+            return false;
+        }
+
+        // no remaining triangle may flip or collapse
+        for (int vertex : {keep, remove}) {
+            for (int face : faces_[static_cast<std::size_t>(vertex)]) {
+                if (dead_[static_cast<std::size_t>(face)]) {
+                    continue;
+                }
+                const glm::ivec3& tri =
+                    triangles_[static_cast<std::size_t>(face)];
+                bool has_keep = tri.x == keep || tri.y == keep || tri.z == keep;
+                bool has_remove =
+                    tri.x == remove || tri.y == remove || tri.z == remove;
+                if (has_keep && has_remove) {
+                    continue;
+                }
+                glm::dvec3 before[3];
+                glm::dvec3 after[3];
+                for (int k = 0; k < 3; ++k) {
+                    before[k] = positions_[tri[k]];
+                    after[k] = tri[k] == vertex ? position : before[k];
+                }
+                glm::dvec3 old_normal =
+                    glm::cross(before[1] - before[0], before[2] - before[0]);
+                glm::dvec3 new_normal =
+                    glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (!(glm::dot(old_normal, new_normal) > 0.0)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void apply(int keep, int remove, const glm::dvec3& position)
+    {
+        positions_[keep] = position;
+        quadrics_[keep] += quadrics_[remove];
+        removed_[remove] = 1;
+        ++stamps_[keep];
+
+        std::vector<int>& kept = faces_[static_cast<std::size_t>(keep)];
+        for (int face : faces_[static_cast<std::size_t>(remove)]) {
+            std::size_t index = static_cast<std::size_t>(face);
+            if (dead_[index]) {
+                continue;
+            }
+            glm::ivec3& tri = triangles_[index];
+            if (tri.x == keep || tri.y == keep || tri.z == keep) {
+                dead_[index] = 1;
+                --live_;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                if (tri[k] == remove) {
+                    tri[k] = keep;
+                }
+            }
+            kept.push_back(face);
+        }
+        std::vector<int>().swap(faces_[static_cast<std::size_t>(remove)]);
+        kept.erase(std::remove_if(kept.begin(), kept.end(),
+                                  [this](int face) {
+                                      return dead_[static_cast<std::size_t>(
+                                                 face)] != 0;
+                                  }),
+                   kept.end());
+
+        ring(keep, ring_a_);
+        std::vector<int> neighbors = ring_a_;
+        for (int vertex : neighbors) {
+            push(keep, vertex);
+        }
+    }
+
+    std::vector<glm::dvec3> positions_;
+
+    std::vector<glm::ivec3> triangles_;
+
+    std::vector<quadric> quadrics_;
+
+    // live and dead triangles of every vertex, dead ones are skipped
+    std::vector<std::vector<int>> faces_;
+
+    std::vector<char> boundary_;
+
+    std::vector<unsigned int> stamps_;
+
+    std::vector<char> removed_;
+
+    std::vector<char> dead_;
+
+    std::priority_queue<collapse, std::vector<collapse>,
+                        std::greater<collapse>>
+        queue_;
+
+    std::size_t live_;
+
+    std::vector<int> ring_a_;
+
+    std::vector<int> ring_b_;
+};
+
+struct triangle_hash {
+    std::size_t operator()(const glm::ivec3& tri) const
+    {
+        return std::hash<int>()(tri.x) ^ (std::hash<int>()(tri.y) * 31) ^
+               (std::hash<int>()(tri.z) * 961);
+    }
+};
+
+} // end of anonymous namespace
+
+mesh simplify(const mesh& source, std::size_t target_triangles)
+{
+    simplifier state(source);
+    state.run(target_triangles);
+    return state.result();
+}
+
+std::vector<mesh> build_lods(const mesh& source,
+                             const std::vector<float>& ratios)
+{
+    std::vector<mesh> lods;
+    lods.reserve(ratios.size());
+    for (float ratio : ratios) {
+        const mesh& previous = lods.empty() ? source : lods.back();
+        std::size_t target = static_cast<std::size_t>(
+            ratio * static_cast<float>(source.triangles.size()));
+        lods.push_back(simplify(previous, target));
+    }
+    return lods;
+}
+
+mesh cluster_vertices(const mesh& source, int resolution)
+{
+    mesh out;
+    if (source.vertices.empty() || resolution < 1) {
+        return out;
+    }
+    glm::vec3 lower = source.vertices[0];
+    glm::vec3 upper = lower;
+    for (const glm::vec3& vertex : source.vertices) {
+        lower = glm::min(lower, vertex);
+        upper = glm::max(upper, vertex);
+    }
+    glm::vec3 extent = upper - lower;
+    float cell_size = std::max(std::max(extent.x, extent.y), extent.z) /
+                      static_cast<float>(resolution);
+    if (!(cell_size > 0.0f)) {
+        cell_size = 1.0f;
+    }
+
+    // cells are keyed by their integer coordinates, which floats hold
+    // exactly for any sensible resolution
+    vertex_table cells;
+    cells.reserve(source.vertices.size() / 4 + 1);
+    std::vector<int> remap(source.vertices.size());
+    std::vector<glm::vec3> sums;
+    std::vector<int> counts;
+    for (std::size_t i = 0; i < source.vertices.size(); ++i) {
+        glm::vec3 cell = glm::min(
+            glm::floor((source.vertices[i] - lower) / cell_size),
+            glm::vec3(static_cast<float>(resolution - 1)));
+        auto result = cells.insert(cell, static_cast<int>(sums.size()));
+        if (result.second) {
+            sums.push_back(glm::vec3(0.0f));
+            counts.push_back(0);
+        }
+        sums[static_cast<std::size_t>(result.first)] += source.vertices[i];
+        ++counts[static_cast<std::size_t>(result.first)];
+        remap[i] = result.first;
+    }
+
+    std::unordered_set<glm::ivec3, triangle_hash> seen;
+    seen.reserve(source.triangles.size() / 4 + 1);
+    std::vector<int> used(sums.size(), -1);
+    for (const glm::ivec3& tri : source.triangles) {
+        glm::ivec3 mapped(remap[static_cast<std::size_t>(tri.x)],
+                          remap[static_cast<std::size_t>(tri.y)],
+                          remap[static_cast<std::size_t>(tri.z)]);
+        if (mapped.x == mapped.y || mapped.y == mapped.z ||
+            mapped.x == mapped.z) {
+            continue;
+        }
+        // rotate the smallest index first, keeping the orientation
+        while (mapped.x > mapped.y || mapped.x > mapped.z) {
+            mapped = glm::ivec3(mapped.y, mapped.z, mapped.x);
+        }
+        if (!seen.insert(mapped).second) {
+            continue;
+        }
+        for (int k = 0; k < 3; ++k) {
+            int& index = used[static_cast<std::size_t>(mapped[k])];
+            if (index == -1) {
+                std::size_t cluster = static_cast<std::size_t>(mapped[k]);
+                index = static_cast<int>(out.vertices.size());
+                out.vertices.push_back(sums[cluster] /
+                                       static_cast<float>(counts[cluster]));
+            }
+            mapped[k] = index;
+        }
+        out.triangles.push_back(mapped);
+    }
+    out.calculate_normals();
+    return out;
+}
+
+} // end namespace glrfw
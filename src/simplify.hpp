@@ -0,0 +1,32 @@
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include <cstddef>
+#include <vector>
+#include "mesh.hpp"
+
+namespace glrfw {
+
+// Decimates source to at most target_triangles triangles by collapsing the
+// edges of least quadric error (Garland and Heckbert 1997). Boundary and
+// non-manifold edges are held in place by constraint planes and only
+// collapse along themselves; collapses that would flip a triangle or make
+// the surface non-manifold are skipped, so fewer triangles than asked for
+// may be removed. The result has vertex normals and no vertex table.
+mesh simplify(const mesh& source, std::size_t target_triangles);
+
+// Builds one level of detail per ratio of the triangle count of source,
+// e.g. {0.5f, 0.25f, 0.1f, 0.02f}. Ratios must be decreasing, every level
+// is simplified from the previous one.
+std::vector<mesh> build_lods(const mesh& source,
+                             const std::vector<float>& ratios);
+
+// Coarse preview of source in linear time. Vertices are snapped to a grid
+// with resolution cells along the longest side of the bounding box and
+// merged into the mean of each cell; triangles that collapse or repeat
+// are dropped. The result has vertex normals and no vertex table.
+mesh cluster_vertices(const mesh& source, int resolution);
+
+} // end namespace glrfw
+
+#endif
@@ -0,0 +1,133 @@
+#include "vertex_table.hpp"
+#include <cstring>
+
+namespace glrfw {
+
+namespace {
+
+// The table is grown once it is more than half full.
+const std::size_t max_load_inverse = 2;
+
+const std::size_t min_capacity = 16;
+
+void make_key(const glm::vec3& vertex, uint32_t* key)
+{
+    // adding +0 turns -0 into +0, so both weld like with operator==
+    glm::vec3 canonical = vertex + glm::vec3(0.0f);
+    std::memcpy(key, &canonical, 3 * sizeof(uint32_t));
+}
+
+std::size_t hash_key(const uint32_t* key)
+{
+    // murmur3 finalizer over the packed coordinates
+    uint64_t h = (uint64_t(key[0]) | (uint64_t(key[1]) << 32)) ^
+                 (uint64_t(key[2]) * UINT64_C(0x9e3779b97f4a7c15));
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return static_cast<std::size_t>(h);
+}
+
+std::size_t next_pow2(std::size_t value)
+{
+    std::size_t result = min_capacity;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // end of anonymous namespace
+
+vertex_table::vertex_table() : slots_(), size_(0)
+{
+}
+
+void vertex_table::reserve(std::size_t count)
+{
+    std::size_t capacity = next_pow2(count * max_load_inverse);
+    if (capacity > slots_.size()) {
+        grow(capacity);
+    }
+}
+
+std::size_t vertex_table::find_slot(const uint32_t* key) const
+{
+    std::size_t mask = slots_.size() - 1;
+    std::size_t pos = hash_key(key) & mask;
+    while (slots_[pos].index != -1 &&
+           std::memcmp(slots_[pos].key, key, sizeof(slots_[pos].key)) != 0) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+int vertex_table::find(const glm::vec3& vertex) const
+{
+    if (slots_.empty()) {
+        return -1;
+    }
+    uint32_t key[3];
+    make_key(vertex, key);
+    return slots_[find_slot(key)].index;
+}
+
+std::pair<int, bool> vertex_table::insert(const glm::vec3& vertex, int index)
+{
+    if ((size_ + 1) * max_load_inverse > slots_.size()) {
+        grow(next_pow2((size_ + 1) * max_load_inverse));
+    }
+    uint32_t key[3];
+    make_key(vertex, key);
+    slot& entry = slots_[find_slot(key)];
+    if (entry.index != -1) {
+        return std::make_pair(entry.index, false);
+    }
+    std::memcpy(entry.key, key, sizeof(key));
+    entry.index = index;
+    ++size_;
+    return std::make_pair(index, true);
+}
+
+std::size_t vertex_table::size() const
+{
+    return size_;
+}
+
+std::size_t vertex_table::capacity() const
+{
+    return slots_.size() / max_load_inverse;
+}
+
+std::size_t vertex_table::memory_usage() const
+{
+    return slots_.capacity() * sizeof(slot);
+}
+
+void vertex_table::clear()
+{
+    std::vector<slot>().swap(slots_);
+    size_ = 0;
+}
+
+std::size_t vertex_table::hash(const glm::vec3& vertex)
+{
+    uint32_t key[3];
+    make_key(vertex, key);
+    return hash_key(key);
+}
+
+void vertex_table::grow(std::size_t capacity)
+{
+    std::vector<slot> old(capacity, slot{{0, 0, 0}, -1});
+    old.swap(slots_);
+    for (const slot& entry : old) {
+        if (entry.index != -1) {
+            slots_[find_slot(entry.key)] = entry;
+        }
+    }
+}
+
+} // end namespace glrfw
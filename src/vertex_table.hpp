@@ -0,0 +1,58 @@
+#ifndef VERTEX_TABLE_HPP
+#define VERTEX_TABLE_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "error.hpp"
+
+namespace glrfw {
+
+// Flat open addressing hash table used to weld vertices. Positions are
+// compared bit by bit (with -0 folded onto +0) and stored together with
+// their index in a single array, probed linearly.
+class vertex_table {
+public:
+    vertex_table();
+
+    // Makes room for count vertices without growing the table.
+    void reserve(std::size_t count);
+
+    // Returns the index of vertex, or -1 if it is not in the table.
+    int find(const glm::vec3& vertex) const;
+
+    // Inserts vertex with index unless it is already present. Returns the
+    // stored index and whether vertex was inserted.
+    std::pair<int, bool> insert(const glm::vec3& vertex, int index);
+
+    std::size_t size() const;
+
+    std::size_t capacity() const;
+
+    // Bytes allocated for the slots.
+    std::size_t memory_usage() const;
+
+    void clear();
+
+    // Hash the table probes with, equal for positions that weld.
+    static std::size_t hash(const glm::vec3& vertex);
+
+private:
+    struct slot {
+        uint32_t key[3];
+
+        int index;
+    };
+
+    void grow(std::size_t capacity);
+
+    std::size_t find_slot(const uint32_t* key) const;
+
+    std::vector<slot> slots_;
+
+    std::size_t size_;
+};
+
+} // end namespace glrfw
+
+#endif
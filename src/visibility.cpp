@@ -0,0 +1,158 @@
+#include "visibility.hpp"
+#include <algorithm>
+#include <cmath>
+#include "optimize.hpp"
+#include "parallel.hpp"
+
+namespace glrfw {
+
+namespace {
+
+// Triangles sweep_coverage traces for every pose before it moves on, so
+// the part of the tree around them stays in cache.
+const std::size_t sweep_tile_size = 4096;
+
+// Sets visible[i - first] for points[i] in [first, last), tracing packets
+// of segments from sensor.
+void trace_points(const bvh& tree, const std::vector<glm::vec3>& points,
+                  const glm::vec3& sensor, std::size_t first,
+                  std::size_t last, unsigned char* visible)
+{
+    std::vector<ray> rays;
+    rays.reserve(bvh::packet_size);
+    for (std::size_t i = first; i < last; i += bvh::packet_size) {
+        std::size_t count = std::min<std::size_t>(bvh::packet_size, last - i);
+        rays.clear();
+        for (std::size_t k = 0; k < count; ++k) {
+            rays.push_back(ray(sensor, points[i + k] - sensor, 0.0f,
+                               1.0f - visibility_bias));
+        }
+        unsigned int hidden =
+            tree.any_hit_packet(rays.data(), static_cast<int>(count));
+        for (std::size_t k = 0; k < count; ++k) {
+            visible[i - first + k] = (hidden >> k & 1u) == 0 ? 1 : 0;
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+std::vector<unsigned char>
+vertex_visibility(const bvh& tree, const std::vector<glm::vec3>& vertices,
+                  const glm::vec3& sensor, unsigned int num_threads)
+{
+    std::vector<unsigned char> visible(vertices.size(), 0);
+    detail::parallel_ranges(
+        detail::thread_count(num_threads, vertices.size()), vertices.size(),
+        [&](std::size_t first, std::size_t last) {
+            trace_points(tree, vertices, sensor, first, last,
+                         &visible[first]);
+        });
+    return visible;
+}
+
+std::vector<unsigned char> vertex_visibility(const bvh& tree,
+                                             const mesh& mesh,
+                                             const glm::vec3& sensor,
+                                             unsigned int num_threads)
+{
+    return vertex_visibility(tree, mesh.vertices, sensor, num_threads);
+}
+
+coverage sweep_coverage(const bvh& tree, const mesh& mesh,
+                        const std::vector<glm::vec3>& sensors,
+                        unsigned int num_threads)
+{
+    std::size_t num_tri = mesh.triangles.size();
+    coverage result;
+    result.triangle_counts.assign(num_tri, 0);
+    result.visible_area.assign(sensors.size(), 0.0f);
+    if (num_tri == 0 || sensors.empty()) {
+        return result;
+    }
+
+    // trace the centroids along a Morton curve, so the rays of a packet
+    // end close to each other and take the same path through the tree
+    std::vector<glm::vec3> centroids(num_tri);
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        const glm::ivec3& tri = mesh.triangles[i];
+        centroids[i] = (mesh.vertices[static_cast<std::size_t>(tri[0])] +
+                        mesh.vertices[static_cast<std::size_t>(tri[1])] +
+                        mesh.vertices[static_cast<std::size_t>(tri[2])]) /
+                       3.0f;
+    }
+    std::vector<int> order(num_tri);
+    {
+        std::vector<int> position = morton_order(centroids.data(), num_tri);
+        for (std::size_t i = 0; i < num_tri; ++i) {
+            order[static_cast<std::size_t>(position[i])] = static_cast<int>(i);
+        }
+    }
+    std::vector<glm::vec3> points(num_tri);
+    std::vector<float> areas(num_tri);
+    for (std::size_t j = 0; j < num_tri; ++j) {
+        std::size_t i = static_cast<std::size_t>(order[j]);
+        const glm::ivec3& tri = mesh.triangles[i];
+        const glm::vec3& a = mesh.vertices[static_cast<std::size_t>(tri[0])];
+        const glm::vec3& b = mesh.vertices[static_cast<std::size_t>(tri[1])];
+        const glm::vec3& c = mesh.vertices[static_cast<std::size_t>(tri[2])];
+        points[j] = centroids[i];
+        areas[j] = 0.5f * glm::length(glm::cross(b - a, c - a));
+    }
+    std::vector<glm::vec3>().swap(centroids);
+
+    // Workers take tiles of triangles and trace every pose for them. The
+    // tiles count disjoint triangles, and their areas are added up per pose
+    // in tile order, so the result does not depend on the number of
+    // threads.
+    std::size_t num_poses = sensors.size();
+    std::size_t num_tiles = (num_tri + sweep_tile_size - 1) / sweep_tile_size;
+    std::vector<double> tile_area(num_tiles * num_poses);
+    detail::parallel_ranges(
+        detail::thread_count(num_threads,
+                             num_tiles * detail::min_chunk_size),
+        num_tiles, [&](std::size_t first, std::size_t last) {
+            std::vector<unsigned char> visible(sweep_tile_size);
+            for (std::size_t tile = first; tile < last; ++tile) {
+                std::size_t begin = tile * sweep_tile_size;
+                std::size_t end = std::min(begin + sweep_tile_size, num_tri);
+                for (std::size_t pose = 0; pose < num_poses; ++pose) {
+                    trace_points(tree, points, sensors[pose], begin, end,
+                                 &visible[0]);
+                    double area = 0.0;
+                    for (std::size_t j = begin; j < end; ++j) {
+                        if (visible[j - begin]) {
+                            ++result.triangle_counts[static_cast<std::size_t>(
+                                order[j])];
+                            area += areas[j];
+                        }
+                    }
+                    tile_area[tile * num_poses + pose] = area;
+                }
+            }
+        });
+    for (std::size_t pose = 0; pose < num_poses; ++pose) {
+        double area = 0.0;
+        for (std::size_t tile = 0; tile < num_tiles; ++tile) {
+            area += tile_area[tile * num_poses + pose];
+        }
+        result.visible_area[pose] = static_cast<float>(area);
+    }
+    return result;
+}
+
+std::vector<glm::vec3> sensor_circle(float radius, float height,
+                                     int num_poses)
+{
+    std::vector<glm::vec3> sensors;
+    for (int i = 0; i < num_poses; ++i) {
+        float angle =
+            glm::radians(360.0f * static_cast<float>(i) /
+                         static_cast<float>(num_poses));
+        sensors.push_back(glm::vec3(radius * std::cos(angle), height,
+                                    radius * std::sin(angle)));
+    }
+    return sensors;
+}
+
+} // end namespace glrfw
@@ -0,0 +1,64 @@
+#ifndef VISIBILITY_HPP
+#define VISIBILITY_HPP
+
+#include <vector>
+#include "bvh.hpp"
+#include "mesh.hpp"
+
+namespace glrfw {
+
+// Fraction of the distance to a vertex that visibility rays leave out at
+// the vertex end, so the triangles around the vertex do not hide it.
+const float visibility_bias = 1e-4f;
+
+// Tests which vertices can be seen from sensor, a point in the same space
+// as the vertices. A vertex is visible if the segment from sensor to it
+// crosses no triangle of tree; no normals are involved, so vertices on the
+// back of an open surface count as visible when nothing is in front of
+// them. Consecutive vertices are traced as one ray packet, so vertices in
+// spatial order (see mesh::reorder_vertices) trace fastest. Returns 1 for
+// visible and 0 for hidden vertices, using num_threads threads, 0 meaning
+// all hardware threads.
+std::vector<unsigned char>
+vertex_visibility(const bvh& tree, const std::vector<glm::vec3>& vertices,
+                  const glm::vec3& sensor, unsigned int num_threads = 1);
+
+// Same as above for the vertices of mesh, tree is usually built from it.
+std::vector<unsigned char> vertex_visibility(const bvh& tree,
+                                             const mesh& mesh,
+                                             const glm::vec3& sensor,
+                                             unsigned int num_threads = 1);
+
+// Visibility of a mesh over a set of sensor poses.
+struct coverage {
+    coverage() : triangle_counts(), visible_area()
+    {
+    }
+
+    // number of poses every triangle is visible from
+    std::vector<int> triangle_counts;
+
+    // total area of the triangles visible from every pose
+    std::vector<float> visible_area;
+};
+
+// Evaluates which triangles of mesh can be seen from each of sensors. A
+// triangle is visible if the segment from the sensor to its centroid is
+// not occluded, as for vertex_visibility. Centroids are traced in Morton
+// order, in tiles of a few thousand triangles that are distributed over
+// num_threads threads, 0 meaning all hardware threads. Each tile is traced
+// for all poses before the next, and the result does not depend on the
+// number of threads.
+coverage sweep_coverage(const bvh& tree, const mesh& mesh,
+                        const std::vector<glm::vec3>& sensors,
+                        unsigned int num_threads = 1);
+
+// num_poses positions on the circle the viewer moves its light along,
+// one every 360 / num_poses degrees starting on the x axis, at the given
+// radius around the y axis and height along it.
+std::vector<glm::vec3> sensor_circle(float radius, float height,
+                                     int num_poses = 360);
+
+} // end namespace glrfw
+
+#endif
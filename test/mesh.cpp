@@ -0,0 +1,1149 @@
+#define BOOST_TEST_MODULE mesh
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <tuple>
+#include <arena.hpp>
+#include <bvh.hpp>
+#include <mesh.hpp>
+#include <kernels.hpp>
+#include <mesh_cache.hpp>
+#include <mesh_soa.hpp>
+#include <optimize.hpp>
+#include <rasterizer.hpp>
+#include <simplify.hpp>
+#include <visibility.hpp>
+#include <vertex_table.hpp>
+#include <error.hpp>
+#include <half_edge.hpp>
+#include <config.h>
+
+bool invalid_file_format(const glrfw::gl_error& ex)
+{
+    return ex.type == glrfw::error_type::invalid_file_format;
+}
+
+bool no_file(const glrfw::gl_error& ex)
+{
+    return ex.type == glrfw::error_type::file_not_found;
+}
+
+std::string temp_file()
+{
+    return (boost::filesystem::temp_directory_path() /
+            boost::filesystem::unique_path("glrfw-%%%%-%%%%.stl"))
+        .string();
+}
+
+// Writes a binary stl with a n x n grid of quads, two triangles each.
+void write_grid_stl(const std::string& file, int n)
+{
+    std::ofstream out(file, std::ios::out | std::ios::binary);
+    std::vector<char> header(80, 0);
+    out.write(&header[0], 80);
+    uint32_t num_tri = static_cast<uint32_t>(2 * n * n);
+    out.write(reinterpret_cast<const char*>(&num_tri), sizeof(num_tri));
+    auto corner = [](int x, int y) {
+        return glm::vec3(static_cast<float>(x), static_cast<float>(y),
+                         static_cast<float>((x * y) % 7));
+    };
+    auto write_tri = [&out](const glm::vec3& a, const glm::vec3& b,
+                            const glm::vec3& c) {
+        glm::vec3 normal(0, 0, 1);
+        uint16_t attribute = 0;
+        out.write(reinterpret_cast<const char*>(&normal), sizeof(normal));
+        out.write(reinterpret_cast<const char*>(&a), sizeof(a));
+        out.write(reinterpret_cast<const char*>(&b), sizeof(b));
+        out.write(reinterpret_cast<const char*>(&c), sizeof(c));
+        out.write(reinterpret_cast<const char*>(&attribute), sizeof(attribute));
+    };
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            write_tri(corner(x, y), corner(x + 1, y), corner(x, y + 1));
+            write_tri(corner(x + 1, y), corner(x + 1, y + 1), corner(x, y + 1));
+        }
+    }
+}
+
+// Parses a grid written by write_grid_stl with the default settings.
+glrfw::mesh grid_mesh(int n)
+{
+    std::string file = temp_file();
+    write_grid_stl(file, n);
+    glrfw::mesh mesh = glrfw::parse_stl(file);
+    boost::filesystem::remove(file);
+    return mesh;
+}
+
+// Largest distance between corresponding normals of a and b, which must
+// have the same size.
+float max_normal_error(const std::vector<glm::vec3>& a,
+                       const std::vector<glm::vec3>& b)
+{
+    float error = 0.0f;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        error = std::max(error, glm::length(a[i] - b[i]));
+    }
+    return error;
+}
+
+BOOST_AUTO_TEST_CASE(parse_stl)
+{
+    glrfw::mesh mapped =
+        glrfw::parse_stl(glrfw::resource_path + std::string("mesh.stl"));
+    glrfw::mesh streamed =
+        glrfw::parse_stl_stream(glrfw::resource_path + std::string("mesh.stl"));
+
+    BOOST_CHECK_EQUAL(mapped.triangles.size(), 968);
+    BOOST_CHECK_EQUAL(mapped.vertices.size(), streamed.vertices.size());
+    BOOST_CHECK_EQUAL(mapped.triangles.size(), streamed.triangles.size());
+    BOOST_CHECK(mapped.vertices == streamed.vertices);
+    BOOST_CHECK(mapped.triangles == streamed.triangles);
+    BOOST_CHECK(mapped.vertex_normals == streamed.vertex_normals);
+}
+
+BOOST_AUTO_TEST_CASE(parse_stl_parallel)
+{
+    // large enough to be split into several chunks
+    std::string file = temp_file();
+    write_grid_stl(file, 200);
+    glrfw::mesh serial = glrfw::parse_stl(file);
+    BOOST_CHECK_EQUAL(serial.vertices.size(), 201 * 201);
+    for (unsigned int threads : {0u, 2u, 3u, 8u}) {
+        glrfw::mesh parallel = glrfw::parse_stl(file, threads);
+        BOOST_CHECK_EQUAL(parallel.vertices.size(), serial.vertices.size());
+        BOOST_CHECK(parallel.vertices == serial.vertices);
+        BOOST_CHECK(parallel.triangles == serial.triangles);
+        // only the rounding of the per thread sums differs
+        BOOST_REQUIRE_EQUAL(parallel.vertex_normals.size(),
+                            serial.vertex_normals.size());
+        BOOST_CHECK_SMALL(
+            max_normal_error(parallel.vertex_normals, serial.vertex_normals),
+            1e-6f);
+    }
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(stream_stl)
+{
+    glrfw::mesh mesh;
+    std::size_t batches = 0;
+    std::size_t largest = 0;
+    std::size_t num_tri = glrfw::stream_stl(
+        glrfw::resource_path + std::string("mesh.stl"), 100,
+        [&](const glrfw::stl_triangle* batch, std::size_t count) {
+            ++batches;
+            largest = std::max(largest, count);
+            for (std::size_t i = 0; i < count; ++i) {
+                mesh.add_triangle(batch[i].a, batch[i].b, batch[i].c);
+            }
+        });
+    BOOST_CHECK_EQUAL(num_tri, 968);
+    BOOST_CHECK_EQUAL(batches, 10);
+    BOOST_CHECK_EQUAL(largest, 100);
+    mesh.calculate_normals();
+    mesh.centralize();
+
+    glrfw::mesh mapped =
+        glrfw::parse_stl(glrfw::resource_path + std::string("mesh.stl"));
+    BOOST_CHECK(mesh.vertices == mapped.vertices);
+    BOOST_CHECK(mesh.triangles == mapped.triangles);
+}
+
+BOOST_AUTO_TEST_CASE(parse_stl_invalid)
+{
+    BOOST_CHECK_EXCEPTION(glrfw::parse_stl("no_such_file.stl"),
+                          glrfw::gl_error, no_file);
+
+    // header claims two triangles but only one record follows
+    std::string file = temp_file();
+    {
+        std::ofstream out(file, std::ios::out | std::ios::binary);
+        std::vector<char> data(84 + 50, 0);
+        data[80] = 2;
+        out.write(&data[0], static_cast<std::streamsize>(data.size()));
+    }
+    BOOST_CHECK_EXCEPTION(glrfw::parse_stl(file), glrfw::gl_error,
+                          invalid_file_format);
+    BOOST_CHECK_EXCEPTION(glrfw::parse_stl_stream(file), glrfw::gl_error,
+                          invalid_file_format);
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(mesh_cache)
+{
+    std::string stl = glrfw::resource_path + std::string("mesh.stl");
+    std::string file = temp_file();
+    glrfw::mesh mesh = glrfw::parse_stl(stl);
+    glrfw::save_mesh_cache(mesh, 42, file);
+
+    {
+        glrfw::mesh_cache cache(file);
+        BOOST_CHECK_EQUAL(cache.source_hash(), 42);
+        BOOST_CHECK_EQUAL(cache.num_vertices(), mesh.vertices.size());
+        BOOST_CHECK_EQUAL(cache.num_triangles(), mesh.triangles.size());
+        BOOST_CHECK(std::equal(mesh.vertices.begin(), mesh.vertices.end(),
+                               cache.vertices()));
+        BOOST_CHECK(std::equal(mesh.vertex_normals.begin(),
+                               mesh.vertex_normals.end(),
+                               cache.vertex_normals()));
+        BOOST_CHECK(std::equal(mesh.triangles.begin(), mesh.triangles.end(),
+                               cache.triangles()));
+        BOOST_CHECK(std::equal(mesh.face_normals.begin(),
+                               mesh.face_normals.end(), cache.face_normals()));
+    }
+
+    // a cache for different content is rebuilt
+    glrfw::mesh_cache rebuilt = glrfw::load_cached_stl(stl, file);
+    BOOST_CHECK_EQUAL(rebuilt.source_hash(), glrfw::hash_file(stl));
+    BOOST_CHECK_EQUAL(rebuilt.num_triangles(), mesh.triangles.size());
+
+    // and so is the full mesh when a level of detail is asked for
+    glrfw::mesh_cache lod = glrfw::load_cached_stl(stl, file, 0.25f);
+    BOOST_CHECK_NE(lod.source_hash(), glrfw::hash_file(stl));
+    BOOST_CHECK_LE(lod.num_triangles(), mesh.triangles.size() / 4);
+
+    // welding with a tolerance shrinks the mesh and is cached separately
+    glrfw::mesh_cache welded = glrfw::load_cached_stl(stl, file, 1.0f, 0.05f);
+    BOOST_CHECK_NE(welded.source_hash(), glrfw::hash_file(stl));
+    BOOST_CHECK_LT(welded.num_vertices(), mesh.vertices.size());
+    BOOST_CHECK_LT(welded.num_triangles(), mesh.triangles.size());
+
+    // a truncated cache is rejected
+    boost::filesystem::remove(file);
+    {
+        std::ofstream out(file, std::ios::out | std::ios::binary);
+        out.write("GLRFWMSH", 8);
+    }
+    BOOST_CHECK_EXCEPTION(glrfw::mesh_cache truncated(file), glrfw::gl_error,
+                          invalid_file_format);
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(hash_bytes)
+{
+    BOOST_CHECK_EQUAL(glrfw::detail::hash_bytes("", 0),
+                      UINT64_C(0xef46db3751d8e999));
+    BOOST_CHECK_EQUAL(glrfw::detail::hash_bytes("a", 1),
+                      UINT64_C(0xd24ec4f1a98c6e5b));
+}
+
+BOOST_AUTO_TEST_CASE(vertex_table)
+{
+    glrfw::vertex_table table;
+    BOOST_CHECK_EQUAL(table.find(glm::vec3(1, 2, 3)), -1);
+
+    // permutations of the same coordinates are different vertices
+    BOOST_CHECK(table.insert(glm::vec3(1, 2, 3), 0).second);
+    BOOST_CHECK(table.insert(glm::vec3(3, 2, 1), 1).second);
+    BOOST_CHECK(table.insert(glm::vec3(2, 1, 3), 2).second);
+    BOOST_CHECK_EQUAL(table.insert(glm::vec3(3, 2, 1), 5).first, 1);
+    BOOST_CHECK(!table.insert(glm::vec3(3, 2, 1), 5).second);
+
+    // -0 and +0 weld
+    BOOST_CHECK(table.insert(glm::vec3(0, 0, 0), 3).second);
+    BOOST_CHECK_EQUAL(table.find(glm::vec3(-0.0f, 0.0f, -0.0f)), 3);
+    BOOST_CHECK_EQUAL(table.size(), 4);
+
+    // indices survive growing the table
+    for (int i = 0; i < 10000; ++i) {
+        table.insert(glm::vec3(static_cast<float>(i), 7, 7), 100 + i);
+    }
+    BOOST_CHECK_EQUAL(table.size(), 10004);
+    BOOST_CHECK_EQUAL(table.find(glm::vec3(1, 2, 3)), 0);
+    BOOST_CHECK_EQUAL(table.find(glm::vec3(4321, 7, 7)), 4421);
+    BOOST_CHECK(table.capacity() >= table.size());
+}
+
+BOOST_AUTO_TEST_CASE(weld_sorted)
+{
+    std::string stl = glrfw::resource_path + std::string("mesh.stl");
+    glrfw::mesh hashed = glrfw::parse_stl(stl);
+    glrfw::mesh sorted = glrfw::parse_stl(stl, 1, glrfw::weld_mode::sort);
+    BOOST_CHECK_EQUAL(sorted.vertices.size(), hashed.vertices.size());
+    BOOST_REQUIRE_EQUAL(sorted.triangles.size(), hashed.triangles.size());
+    for (std::size_t i = 0; i < sorted.triangles.size(); ++i) {
+        for (int k = 0; k < 3; ++k) {
+            BOOST_CHECK(sorted.vertices[sorted.triangles[i][k]] ==
+                        hashed.vertices[hashed.triangles[i][k]]);
+        }
+    }
+    BOOST_CHECK(sorted.face_normals == hashed.face_normals);
+
+    // the vertex order does not depend on the triangle order
+    std::vector<glm::vec3> corners;
+    glrfw::stream_stl(stl, 4096, [&corners](const glrfw::stl_triangle* batch,
+                                            std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            corners.push_back(batch[i].a);
+            corners.push_back(batch[i].b);
+            corners.push_back(batch[i].c);
+        }
+    });
+    std::vector<glm::vec3> reversed;
+    for (std::size_t i = corners.size(); i > 0; i -= 3) {
+        reversed.insert(reversed.end(), corners.begin() + i - 3,
+                        corners.begin() + i);
+    }
+    std::size_t num_tri = corners.size() / 3;
+    BOOST_CHECK(glrfw::weld_sorted(corners.data(), num_tri).vertices ==
+                glrfw::weld_sorted(reversed.data(), num_tri).vertices);
+}
+
+BOOST_AUTO_TEST_CASE(merge_vertices)
+{
+    // two triangles sharing an edge whose copies differ by round off
+    glrfw::mesh mesh;
+    mesh.add_triangle(glm::vec3(0, 0, 0), glm::vec3(1, 0, 0),
+                      glm::vec3(0, 1, 0));
+    mesh.add_triangle(glm::vec3(1.00001f, 0, 0), glm::vec3(1, 1, 0),
+                      glm::vec3(0, 1.00001f, 0));
+    // and a sliver that collapses
+    mesh.add_triangle(glm::vec3(5, 5, 5), glm::vec3(5.00001f, 5, 5),
+                      glm::vec3(6, 5, 5));
+    mesh.calculate_normals();
+    mesh.build_neighbors();
+    BOOST_CHECK_EQUAL(mesh.vertices.size(), 9);
+
+    // three copies merge, and the two corners left of the sliver are
+    // removed with it
+    BOOST_CHECK_EQUAL(mesh.merge_vertices(0.0001f), 5);
+    BOOST_CHECK_EQUAL(mesh.vertices.size(), 4);
+    BOOST_REQUIRE_EQUAL(mesh.triangles.size(), 2);
+    BOOST_CHECK(mesh.triangles[1] == glm::ivec3(1, 3, 2));
+    BOOST_CHECK(mesh.vertices[3] == glm::vec3(1, 1, 0));
+    BOOST_CHECK_EQUAL(mesh.face_normals.size(), 2);
+    BOOST_CHECK_EQUAL(mesh.vertex_normals.size(), 4);
+    BOOST_CHECK_EQUAL(mesh.neighbors.size(1), 2);
+
+    // merged positions still weld onto their representative
+    BOOST_CHECK_EQUAL(mesh.find_index(glm::vec3(0, 1.00001f, 0)), 2);
+    BOOST_CHECK_EQUAL(mesh.find_index(glm::vec3(5, 5, 5)), -1);
+
+    glrfw::mesh stl =
+        glrfw::parse_stl(glrfw::resource_path + std::string("mesh.stl"));
+    std::size_t num_vertices = stl.vertices.size();
+    BOOST_CHECK_EQUAL(stl.merge_vertices(1e-7f), 0);
+    BOOST_CHECK_EQUAL(stl.vertices.size(), num_vertices);
+}
+
+BOOST_AUTO_TEST_CASE(build_neighbors)
+{
+    glrfw::mesh mesh =
+        glrfw::parse_stl(glrfw::resource_path + std::string("mesh.stl"));
+    BOOST_CHECK(!mesh.has_neighbors());
+    mesh.build_neighbors();
+    BOOST_CHECK(mesh.has_neighbors());
+    const glrfw::adjacency& adjacency = mesh.neighbors;
+    BOOST_REQUIRE_EQUAL(adjacency.offsets.size(), mesh.vertices.size() + 1);
+    BOOST_CHECK_EQUAL(adjacency.faces.size(), 3 * mesh.triangles.size());
+
+    // every triangle is listed once under each of its corners, in order
+    std::vector<int> seen(mesh.triangles.size(), 0);
+    for (int i = 0; i < static_cast<int>(mesh.vertices.size()); ++i) {
+        BOOST_CHECK(std::is_sorted(adjacency.begin(i), adjacency.end(i)));
+        for (const int* face = adjacency.begin(i); face != adjacency.end(i);
+             ++face) {
+            const glm::ivec3& tri = mesh.triangles[*face];
+            BOOST_CHECK(tri.x == i || tri.y == i || tri.z == i);
+            ++seen[*face];
+        }
+    }
+    BOOST_CHECK(std::all_of(seen.begin(), seen.end(),
+                            [](int count) { return count == 3; }));
+}
+
+BOOST_AUTO_TEST_CASE(calculate_normals)
+{
+    // two triangles of different area sharing an edge, the larger one
+    // weighs more at the shared vertices
+    glrfw::mesh mesh;
+    mesh.add_triangle(glm::vec3(0, 0, 0), glm::vec3(4, 0, 0),
+                      glm::vec3(0, 4, 0));
+    mesh.add_triangle(glm::vec3(4, 0, 0), glm::vec3(0, 4, 0),
+                      glm::vec3(0, 0, 1));
+    mesh.calculate_normals();
+    for (const glm::vec3& normal : mesh.vertex_normals) {
+        BOOST_CHECK_CLOSE(glm::length(normal), 1.0f, 1e-4f);
+    }
+    BOOST_CHECK(mesh.vertex_normals[0] == glm::vec3(0, 0, 1));
+    glm::vec3 expected = glm::normalize(
+        glm::cross(glm::vec3(4, 0, 0), glm::vec3(0, 4, 0)) +
+        glm::cross(glm::vec3(-4, 4, 0), glm::vec3(-4, 0, 1)));
+    BOOST_CHECK_CLOSE(glm::dot(mesh.vertex_normals[1], expected), 1.0f, 1e-4f);
+
+    // the result only depends on the number of threads through rounding
+    glrfw::mesh grid = grid_mesh(200);
+    std::vector<glm::vec3> serial = grid.vertex_normals;
+    for (unsigned int threads : {0u, 2u, 3u, 5u}) {
+        grid.calculate_normals(threads);
+        BOOST_REQUIRE_EQUAL(grid.vertex_normals.size(), serial.size());
+        BOOST_CHECK_SMALL(max_normal_error(grid.vertex_normals, serial),
+                          1e-6f);
+    }
+    // stale neighbors are not read
+    grid.build_neighbors();
+    std::swap(grid.triangles.front(), grid.triangles.back());
+    grid.calculate_normals(2);
+    BOOST_CHECK_SMALL(max_normal_error(grid.vertex_normals, serial), 1e-6f);
+}
+
+BOOST_AUTO_TEST_CASE(compute_face_normals)
+{
+    glrfw::mesh mesh =
+        glrfw::parse_stl(glrfw::resource_path + std::string("mesh.stl"));
+    // leave a remainder for the scalar path
+    std::size_t num_tri = mesh.triangles.size() - 3;
+    std::vector<glm::vec3> normals(num_tri);
+    std::vector<float> areas(num_tri);
+    glrfw::compute_face_normals(mesh.vertices.data(), mesh.triangles.data(),
+                                num_tri, normals.data(), areas.data());
+    for (std::size_t i = 0; i < num_tri; ++i) {
+        const glm::ivec3& tri = mesh.triangles[i];
+        const glm::vec3& a = mesh.vertices[tri.x];
+        glm::vec3 cross = glm::cross(mesh.vertices[tri.y] - a,
+                                     mesh.vertices[tri.z] - a);
+        BOOST_CHECK(normals[i] == glm::normalize(cross));
+        BOOST_CHECK_EQUAL(areas[i], 0.5f * glm::length(cross));
+    }
+    BOOST_CHECK_EQUAL(mesh.face_normals.size(), mesh.triangles.size());
+}
+
+BOOST_AUTO_TEST_CASE(add_triangles)
+{
+    std::vector<glm::vec3> corners{{0, 0, 0}, {1, 0, 0}, {0, 1, 0},
+                                   {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                                   {0, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    glrfw::mesh single;
+    for (std::size_t i = 0; i < corners.size(); i += 3) {
+        single.add_triangle(corners[i], corners[i + 1], corners[i + 2]);
+    }
+    glrfw::mesh bulk;
+    bulk.add_triangles(corners.data(), 2);
+    bulk.add_triangles(corners.data() + 6, 1);
+    BOOST_CHECK(bulk.vertices == single.vertices);
+    BOOST_CHECK(bulk.triangles == single.triangles);
+
+    // precomputed normals are kept, earlier triangles get theirs calculated
+    glrfw::mesh with_normals;
+    with_normals.add_triangle(corners[0], corners[1], corners[2]);
+    std::vector<glm::vec3> normals{{0, 0, 1}, {1, 0, 0}};
+    with_normals.add_triangles(corners.data() + 3, 2, normals.data());
+    BOOST_REQUIRE_EQUAL(with_normals.face_normals.size(), 3);
+    BOOST_CHECK(with_normals.face_normals[0] == glm::vec3(0, 0, 1));
+    BOOST_CHECK(with_normals.face_normals[2] == glm::vec3(1, 0, 0));
+}
+
+BOOST_AUTO_TEST_CASE(mesh_soa)
+{
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    // parse_stl calculated the normals before centering the mesh
+    mesh.calculate_normals();
+    glrfw::mesh_soa soa(mesh);
+    BOOST_REQUIRE_EQUAL(soa.vertices.size(), mesh.vertices.size());
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(soa.vertices.x.data()) %
+                          32,
+                      0);
+
+    // converting back is exact
+    std::vector<glm::vec3> vertices(mesh.vertices.size());
+    soa.vertices.interleave(vertices.data());
+    BOOST_CHECK(vertices == mesh.vertices);
+
+    glm::vec3 lower = mesh.vertices[0];
+    glm::vec3 upper = lower;
+    for (const auto& v : mesh.vertices) {
+        lower = glm::min(lower, v);
+        upper = glm::max(upper, v);
+    }
+    auto bounds = soa.bounds();
+    BOOST_CHECK(bounds.first == lower);
+    BOOST_CHECK(bounds.second == upper);
+
+    soa.calculate_normals();
+    for (std::size_t i = 0; i < mesh.face_normals.size(); ++i) {
+        BOOST_CHECK(soa.face_normals.get(i) == mesh.face_normals[i]);
+    }
+    for (std::size_t i = 0; i < mesh.vertex_normals.size(); ++i) {
+        BOOST_CHECK_SMALL(
+            glm::length(soa.vertex_normals.get(i) - mesh.vertex_normals[i]),
+            1e-5f);
+    }
+
+    // parse_stl already centered the mesh
+    soa.centralize();
+    for (std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+        BOOST_CHECK_SMALL(glm::length(soa.vertices.get(i) - mesh.vertices[i]),
+                          1e-3f);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mesh_soa_empty)
+{
+    glrfw::mesh_soa soa{glrfw::mesh()};
+    BOOST_CHECK_EQUAL(soa.vertices.size(), 0);
+    auto bounds = soa.bounds();
+    float inf = std::numeric_limits<float>::infinity();
+    BOOST_CHECK(bounds.first == glm::vec3(inf));
+    BOOST_CHECK(bounds.second == glm::vec3(-inf));
+    soa.calculate_normals();
+    soa.centralize();
+    BOOST_CHECK_EQUAL(soa.vertices.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(arena)
+{
+    glrfw::arena scratch(1024);
+    void* first = scratch.allocate(100, 1);
+    void* second = scratch.allocate(8, 8);
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(second) % 8, 0);
+    BOOST_CHECK_EQUAL(scratch.used(), 108);
+    // only the last allocation is handed back right away
+    scratch.deallocate(first, 100);
+    scratch.deallocate(second, 8);
+    BOOST_CHECK_EQUAL(scratch.used(), 100);
+    scratch.allocate(4096, 16);
+    BOOST_CHECK_GE(scratch.capacity(), 1024 + 4096);
+    scratch.release();
+    BOOST_CHECK_EQUAL(scratch.capacity(), 0);
+    BOOST_CHECK_EQUAL(scratch.used(), 0);
+
+    // building through an arena gives the same mesh as the heap
+    std::string file = temp_file();
+    write_grid_stl(file, 20);
+    glrfw::mesh heap = glrfw::parse_stl(file);
+    for (auto mode : {glrfw::weld_mode::hash, glrfw::weld_mode::sort}) {
+        glrfw::mesh mesh = glrfw::parse_stl(file, 1, mode, &scratch);
+        BOOST_CHECK(mesh.scratch == &scratch);
+        BOOST_CHECK_GT(scratch.capacity(), 0);
+        if (mode == glrfw::weld_mode::hash) {
+            BOOST_CHECK(mesh.vertices == heap.vertices);
+            BOOST_CHECK(mesh.triangles == heap.triangles);
+            BOOST_CHECK(mesh.vertex_normals == heap.vertex_normals);
+        }
+        mesh.build_neighbors();
+        BOOST_CHECK_EQUAL(mesh.merge_vertices(1e-6f), 0);
+        scratch.release();
+    }
+    boost::filesystem::remove(file);
+}
+
+BOOST_AUTO_TEST_CASE(finalize)
+{
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    mesh.build_neighbors();
+    std::vector<glm::vec3> vertices = mesh.vertices;
+    std::vector<glm::ivec3> triangles = mesh.triangles;
+    std::size_t before = mesh.memory_usage();
+    mesh.finalize();
+    BOOST_CHECK_LT(mesh.memory_usage(), before);
+    BOOST_CHECK_EQUAL(mesh.indices.size(), 0);
+    BOOST_CHECK_EQUAL(mesh.indices.memory_usage(), 0);
+    BOOST_CHECK(!mesh.has_neighbors());
+    BOOST_CHECK(mesh.vertices == vertices);
+    BOOST_CHECK(mesh.triangles == triangles);
+
+    // adjacency and welding come back when needed
+    BOOST_CHECK_EQUAL(mesh.get_neighbors().faces.size(), 3 * triangles.size());
+    BOOST_CHECK(mesh.has_neighbors());
+    mesh.add_triangle(vertices[triangles[0].x], vertices[triangles[0].y],
+                      vertices[triangles[0].z]);
+    BOOST_CHECK_EQUAL(mesh.vertices.size(), vertices.size());
+    BOOST_CHECK(mesh.triangles.back() == triangles[0]);
+}
+
+BOOST_AUTO_TEST_CASE(half_edges)
+{
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    glrfw::half_edges edges(mesh.triangles, mesh.vertices.size());
+    BOOST_REQUIRE_EQUAL(edges.size(), 3 * mesh.triangles.size());
+    for (int edge = 0; edge < static_cast<int>(edges.size()); ++edge) {
+        BOOST_CHECK_EQUAL(edges.next(edges.prev(edge)), edge);
+        BOOST_CHECK_EQUAL(edges.next(edges.next(edges.next(edge))), edge);
+        BOOST_CHECK_EQUAL(edges.face(edges.next(edge)), edges.face(edge));
+        int opposite = edges.opposite(edge);
+        if (opposite != -1) {
+            BOOST_CHECK_EQUAL(edges.opposite(opposite), edge);
+            BOOST_CHECK_EQUAL(edges.vertex(opposite), edges.target(edge));
+            BOOST_CHECK_EQUAL(edges.target(opposite), edges.vertex(edge));
+        }
+    }
+
+    // the one-ring of a vertex is made of its adjacent triangles, all of
+    // them unless the vertex joins separate fans
+    const glrfw::adjacency& neighbors = mesh.get_neighbors();
+    int split_fans = 0;
+    for (int vertex = 0; vertex < static_cast<int>(mesh.vertices.size());
+         ++vertex) {
+        int start = edges.outgoing(vertex);
+        BOOST_REQUIRE_NE(start, -1);
+        BOOST_CHECK_EQUAL(edges.vertex(start), vertex);
+        std::vector<int> ring;
+        int edge = start;
+        do {
+            ring.push_back(edges.face(edge));
+            edge = edges.opposite(edges.prev(edge));
+        } while (edge != -1 && edge != start);
+        std::sort(ring.begin(), ring.end());
+        BOOST_CHECK(std::includes(neighbors.begin(vertex),
+                                  neighbors.end(vertex), ring.begin(),
+                                  ring.end()));
+        if (static_cast<int>(ring.size()) != neighbors.size(vertex)) {
+            ++split_fans;
+        }
+    }
+    // mesh.stl has two vertices where separate sheets touch
+    BOOST_CHECK_EQUAL(split_fans, 2);
+
+    // a fan of three triangles around one edge, and an open triangle
+    std::vector<glm::ivec3> fan{{0, 1, 2}, {1, 0, 3}, {0, 1, 4}, {5, 6, 7}};
+    glrfw::half_edges non_manifold(fan, 8);
+    BOOST_CHECK_EQUAL(non_manifold.non_manifold_edges().size(), 3);
+    BOOST_CHECK(non_manifold.is_non_manifold(0));
+    BOOST_CHECK_EQUAL(non_manifold.opposite(0), -1);
+    BOOST_CHECK(non_manifold.is_boundary(9));
+    BOOST_CHECK(!non_manifold.is_non_manifold(9));
+    BOOST_CHECK(non_manifold.is_boundary(non_manifold.outgoing(0)));
+}
+
+BOOST_AUTO_TEST_CASE(acmr)
+{
+    // with three entries the first triangle is evicted by the second, so
+    // all nine corners miss; a fourth entry keeps 3 and 4 in the cache
+    std::vector<glm::ivec3> triangles{{0, 1, 2}, {3, 4, 5}, {0, 3, 4}};
+    BOOST_CHECK_CLOSE(glrfw::acmr(triangles.data(), triangles.size(), 6, 3),
+                      3.0f, 1e-4);
+    BOOST_CHECK_CLOSE(glrfw::acmr(triangles.data(), triangles.size(), 6, 4),
+                      7.0f / 3.0f, 1e-4);
+    // hits do not refresh a fifo entry
+    std::vector<glm::ivec3> reuse{{0, 1, 2}, {0, 2, 3}, {0, 3, 4}};
+    BOOST_CHECK_CLOSE(glrfw::acmr(reuse.data(), reuse.size(), 5, 3),
+                      6.0f / 3.0f, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(optimize_vertex_cache)
+{
+    glrfw::mesh mesh = grid_mesh(60);
+    // scramble the triangles like scanner output
+    std::vector<int> order(mesh.triangles.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<int>((i * 7919) % order.size());
+    }
+    std::vector<glm::ivec3> scrambled;
+    for (int i : order) {
+        scrambled.push_back(mesh.triangles[static_cast<std::size_t>(i)]);
+    }
+    mesh.triangles = scrambled;
+    mesh.calculate_face_normals();
+    mesh.build_neighbors();
+
+    std::vector<glm::ivec3> before = mesh.triangles;
+    auto acmr = mesh.optimize_vertex_cache();
+    BOOST_CHECK_CLOSE(acmr.first,
+                      glrfw::acmr(before.data(), before.size(),
+                                  mesh.vertices.size()),
+                      1e-4);
+    BOOST_CHECK_GT(acmr.first, 2.0f);
+    BOOST_CHECK_LT(acmr.second, 0.8f);
+    BOOST_CHECK(mesh.has_neighbors());
+
+    // same triangles in a new order, face normals moved along
+    std::vector<glm::ivec3> after = mesh.triangles;
+    auto less = [](const glm::ivec3& a, const glm::ivec3& b) {
+        return std::make_tuple(a.x, a.y, a.z) < std::make_tuple(b.x, b.y, b.z);
+    };
+    std::sort(before.begin(), before.end(), less);
+    std::sort(after.begin(), after.end(), less);
+    BOOST_CHECK(before == after);
+    std::vector<glm::vec3> normals = mesh.face_normals;
+    mesh.calculate_face_normals();
+    BOOST_CHECK(normals == mesh.face_normals);
+}
+
+BOOST_AUTO_TEST_CASE(reorder_vertices)
+{
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    mesh.optimize_vertex_cache();
+    mesh.build_neighbors();
+    auto corners = [](const glrfw::mesh& source) {
+        std::vector<glm::vec3> result;
+        for (const glm::ivec3& tri : source.triangles) {
+            for (int k = 0; k < 3; ++k) {
+                result.push_back(source.vertices[tri[k]]);
+            }
+        }
+        return result;
+    };
+    std::vector<glm::vec3> expected = corners(mesh);
+
+    mesh.reorder_vertices();
+    BOOST_CHECK(corners(mesh) == expected);
+    BOOST_CHECK(mesh.has_neighbors());
+    BOOST_CHECK_EQUAL(mesh.find_index(mesh.vertices[5]), 5);
+    // the index buffer reads vertices front to back
+    int seen = -1;
+    for (const glm::ivec3& tri : mesh.triangles) {
+        for (int k = 0; k < 3; ++k) {
+            BOOST_CHECK_LE(tri[k], seen + 1);
+            seen = std::max(seen, tri[k]);
+        }
+    }
+
+    mesh.reorder_vertices(glrfw::vertex_order::morton);
+    BOOST_CHECK(corners(mesh) == expected);
+    glm::vec3 lower = mesh.vertices[0];
+    glm::vec3 upper = lower;
+    for (const glm::vec3& v : mesh.vertices) {
+        lower = glm::min(lower, v);
+        upper = glm::max(upper, v);
+    }
+    uint32_t previous = 0;
+    for (const glm::vec3& v : mesh.vertices) {
+        glm::uvec3 cell((v - lower) * (1023.0f / (upper - lower)));
+        uint32_t code = glrfw::detail::morton_code(cell.x, cell.y, cell.z);
+        BOOST_CHECK_LE(previous, code);
+        previous = code;
+    }
+    BOOST_CHECK_EQUAL(glrfw::detail::morton_code(1, 0, 0), 1);
+    BOOST_CHECK_EQUAL(glrfw::detail::morton_code(0, 1, 0), 2);
+    BOOST_CHECK_EQUAL(glrfw::detail::morton_code(0, 0, 1), 4);
+    BOOST_CHECK_EQUAL(glrfw::detail::morton_code(1023, 1023, 1023),
+                      0x3fffffff);
+}
+
+BOOST_AUTO_TEST_CASE(simplify)
+{
+    // a flat 16 x 16 grid keeps its outline and area
+    const int n = 16;
+    std::vector<glm::vec3> corners;
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            glm::vec3 a(x, y, 0), b(x + 1, y, 0), c(x, y + 1, 0),
+                d(x + 1, y + 1, 0);
+            corners.insert(corners.end(), {a, b, c, b, d, c});
+        }
+    }
+    glrfw::mesh grid;
+    grid.add_triangles(corners.data(), corners.size() / 3);
+    glrfw::mesh coarse = glrfw::simplify(grid, 64);
+    BOOST_CHECK_LE(coarse.triangles.size(), 64);
+    BOOST_CHECK_EQUAL(coarse.vertex_normals.size(), coarse.vertices.size());
+    float area = 0.0f;
+    for (const glm::ivec3& tri : coarse.triangles) {
+        glm::vec3 cross =
+            glm::cross(coarse.vertices[tri.y] - coarse.vertices[tri.x],
+                       coarse.vertices[tri.z] - coarse.vertices[tri.x]);
+        // no triangle is flipped
+        BOOST_CHECK_GT(cross.z, 0.0f);
+        area += 0.5f * glm::length(cross);
+    }
+    BOOST_CHECK_CLOSE(area, float(n * n), 1e-3);
+    glrfw::half_edges edges(coarse.triangles, coarse.vertices.size());
+    for (int edge = 0; edge < static_cast<int>(edges.size()); ++edge) {
+        if (!edges.is_boundary(edge)) {
+            continue;
+        }
+        glm::vec3 a = coarse.vertices[edges.vertex(edge)];
+        glm::vec3 b = coarse.vertices[edges.target(edge)];
+        auto both = [](float u, float v, float side) {
+            return std::abs(u - side) < 1e-4f && std::abs(v - side) < 1e-4f;
+        };
+        bool on_side = both(a.x, b.x, 0) || both(a.x, b.x, n) ||
+                       both(a.y, b.y, 0) || both(a.y, b.y, n);
+        BOOST_CHECK(on_side);
+    }
+
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    std::vector<glrfw::mesh> lods =
+        glrfw::build_lods(mesh, {0.5f, 0.25f, 0.1f});
+    BOOST_REQUIRE_EQUAL(lods.size(), 3);
+    BOOST_CHECK_LE(lods[0].triangles.size(), mesh.triangles.size() / 2);
+    BOOST_CHECK_LT(lods[1].triangles.size(), lods[0].triangles.size());
+    BOOST_CHECK_LT(lods[2].triangles.size(), lods[1].triangles.size());
+    for (const glrfw::mesh& lod : lods) {
+        glrfw::half_edges lod_edges(lod.triangles, lod.vertices.size());
+        BOOST_CHECK(lod_edges.non_manifold_edges().empty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cluster_vertices)
+{
+    glrfw::mesh mesh = glrfw::parse_stl(glrfw::resource_path + "mesh.stl");
+    glrfw::mesh preview = glrfw::cluster_vertices(mesh, 8);
+    BOOST_CHECK_GT(preview.triangles.size(), 0);
+    BOOST_CHECK_LT(preview.triangles.size(), mesh.triangles.size() / 4);
+    BOOST_CHECK_LE(preview.vertices.size(), 8 * 8 * 8);
+    BOOST_CHECK_EQUAL(preview.vertex_normals.size(), preview.vertices.size());
+
+    std::vector<glm::ivec3> triangles;
+    for (const glm::ivec3& tri : preview.triangles) {
+        BOOST_CHECK(tri.x != tri.y && tri.y != tri.z && tri.x != tri.z);
+        int first = std::min(std::min(tri.x, tri.y), tri.z);
+        glm::ivec3 rotated = tri;
+        while (rotated.x != first) {
+            rotated = glm::ivec3(rotated.y, rotated.z, rotated.x);
+        }
+        triangles.push_back(rotated);
+    }
+    auto less = [](const glm::ivec3& a, const glm::ivec3& b) {
+        return std::make_tuple(a.x, a.y, a.z) < std::make_tuple(b.x, b.y, b.z);
+    };
+    std::sort(triangles.begin(), triangles.end(), less);
+    BOOST_CHECK(std::adjacent_find(triangles.begin(), triangles.end()) ==
+                triangles.end());
+
+    // a fine grid keeps every vertex
+    glrfw::mesh same = glrfw::cluster_vertices(mesh, 1 << 20);
+    BOOST_CHECK_EQUAL(same.triangles.size(), mesh.triangles.size());
+}
+
+// Closest hit by testing every triangle from both sides.
+glrfw::ray_hit brute_force_hit(const glrfw::mesh& mesh, const glrfw::ray& r)
+{
+    glrfw::ray_hit best;
+    for (std::size_t i = 0; i < mesh.triangles.size(); ++i) {
+        const glm::ivec3& tri = mesh.triangles[i];
+        glm::dvec3 a = mesh.vertices[tri.x];
+        glm::dvec3 normal = glm::cross(glm::dvec3(mesh.vertices[tri.y]) - a,
+                                       glm::dvec3(mesh.vertices[tri.z]) - a);
+        glm::dvec3 origin = r.origin;
+        glm::dvec3 direction = r.direction;
+        double t = glm::dot(a - origin, normal) / glm::dot(direction, normal);
+        if (!(t > r.t_min) || !(t < best.t)) {
+            continue;
+        }
+        // inside if the point is on the same side of every edge
+        glm::dvec3 point = origin + t * direction;
+        bool inside = true;
+        for (int k = 0; k < 3; ++k) {
+            glm::dvec3 from = mesh.vertices[tri[k]];
+            glm::dvec3 to = mesh.vertices[tri[(k + 1) % 3]];
+            inside = inside &&
+                     glm::dot(glm::cross(to - from, point - from), normal) >=
+                         0.0;
+        }
+        if (inside) {
+            best.triangle = static_cast<int>(i);
+            best.t = static_cast<float>(t);
+        }
+    }
+    return best;
+}
+
+BOOST_AUTO_TEST_CASE(bvh)
+{
+    glrfw::mesh mesh = grid_mesh(60);
+    glrfw::bvh tree(mesh);
+    glrfw::bvh parallel(mesh, 4);
+    BOOST_CHECK_EQUAL(tree.num_nodes(), parallel.num_nodes());
+    BOOST_CHECK_LT(tree.num_nodes(), 2 * mesh.triangles.size());
+
+    // rays from above and below towards random points of the grid
+    std::vector<glrfw::ray> rays;
+    for (int i = 0; i < 500; ++i) {
+        glm::vec3 target(float((i * 37) % 61) - 30.37f,
+                         float((i * 53) % 59) - 29.71f, 0.0f);
+        glm::vec3 origin(float(i % 13) - 6.13f, float(i % 7) - 3.29f,
+                         i % 2 ? 40.0f : -40.0f);
+        rays.push_back(glrfw::ray(origin, target - origin));
+    }
+    int hits = 0;
+    for (const glrfw::ray& r : rays) {
+        glrfw::ray_hit expected = brute_force_hit(mesh, r);
+        glrfw::ray_hit hit = tree.closest_hit(r);
+        BOOST_CHECK_EQUAL(parallel.closest_hit(r).triangle, hit.triangle);
+        BOOST_CHECK_EQUAL(tree.any_hit(r), hit.triangle != -1);
+        if (expected.triangle == -1) {
+            BOOST_CHECK_EQUAL(hit.triangle, -1);
+            continue;
+        }
+        ++hits;
+        BOOST_CHECK_CLOSE(hit.t, expected.t, 1e-3);
+        // t limits the search
+        BOOST_CHECK(!tree.any_hit(glrfw::ray(r.origin, r.direction, 0.0f,
+                                             0.99f * expected.t)));
+    }
+    BOOST_CHECK_GT(hits, 250);
+
+    // after moving the mesh the same rays hit the moved triangles
+    glm::vec3 offset(0.0f, 0.0f, 5.0f);
+    for (glm::vec3& vertex : mesh.vertices) {
+        vertex += offset;
+    }
+    tree.refit(mesh.vertices, mesh.triangles);
+    for (const glrfw::ray& r : rays) {
+        glrfw::ray_hit expected = brute_force_hit(mesh, r);
+        glrfw::ray_hit hit = tree.closest_hit(r);
+        BOOST_CHECK_EQUAL(hit.triangle == -1, expected.triangle == -1);
+        if (expected.triangle != -1) {
+            BOOST_CHECK_CLOSE(hit.t, expected.t, 1e-3);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(vertex_visibility)
+{
+    glrfw::mesh scene = grid_mesh(200);
+    std::size_t num_grid = scene.vertices.size();
+    // a square hovering over part of the grid, parse_stl moved the grid
+    // so positions are relative to its lower corner
+    glm::vec3 lower = scene.vertices[0];
+    for (const glm::vec3& vertex : scene.vertices) {
+        lower = glm::min(lower, vertex);
+    }
+    int first = static_cast<int>(num_grid);
+    scene.vertices.push_back(lower + glm::vec3(40.5f, 40.5f, 50.0f));
+    scene.vertices.push_back(lower + glm::vec3(80.5f, 40.5f, 50.0f));
+    scene.vertices.push_back(lower + glm::vec3(80.5f, 80.5f, 50.0f));
+    scene.vertices.push_back(lower + glm::vec3(40.5f, 80.5f, 50.0f));
+    scene.triangles.push_back(glm::ivec3(first, first + 1, first + 2));
+    scene.triangles.push_back(glm::ivec3(first, first + 2, first + 3));
+    glrfw::bvh tree(scene);
+    glm::vec3 sensor = lower + glm::vec3(100.0f, 100.0f, 4000.0f);
+
+    std::vector<unsigned char> visible =
+        glrfw::vertex_visibility(tree, scene, sensor);
+    BOOST_REQUIRE_EQUAL(visible.size(), scene.vertices.size());
+    BOOST_CHECK(glrfw::vertex_visibility(tree, scene, sensor, 0) == visible);
+    std::size_t hidden = 0;
+    for (std::size_t i = 0; i < scene.vertices.size(); ++i) {
+        const glm::vec3& vertex = scene.vertices[i];
+        // packets agree with single rays
+        glrfw::ray segment(sensor, vertex - sensor, 0.0f,
+                           1.0f - glrfw::visibility_bias);
+        BOOST_CHECK_EQUAL(visible[i] == 0, tree.any_hit(segment));
+        if (i >= num_grid) {
+            BOOST_CHECK(visible[i]);
+            continue;
+        }
+        // the sensor is high enough that only the square hides grid vertices
+        glm::vec3 start = sensor - lower;
+        glm::vec3 end = vertex - lower;
+        float t = (50.0f - start.z) / (end.z - start.z);
+        glm::vec3 cross = start + t * (end - start);
+        bool shadowed = cross.x > 40.5f && cross.x < 80.5f &&
+                        cross.y > 40.5f && cross.y < 80.5f;
+        BOOST_CHECK_EQUAL(visible[i] == 0, shadowed);
+        hidden += visible[i] == 0;
+    }
+    BOOST_CHECK_GT(hidden, 1000);
+
+    // partial packets
+    glrfw::ray rays[3] = {
+        glrfw::ray(sensor, scene.vertices[0] - sensor, 0.0f, 0.9f),
+        glrfw::ray(sensor, lower + glm::vec3(60.0f, 60.0f, 0.0f) - sensor),
+        glrfw::ray(sensor, glm::vec3(0.0f, 0.0f, 1.0f))};
+    BOOST_CHECK_EQUAL(tree.any_hit_packet(rays, 3), 2u);
+    BOOST_CHECK_EQUAL(tree.any_hit_packet(rays + 1, 1), 1u);
+    BOOST_CHECK_EQUAL(tree.any_hit_packet(rays, 0), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(sweep_coverage)
+{
+    std::vector<glm::vec3> circle = glrfw::sensor_circle(100.0f, 5.0f, 4);
+    BOOST_REQUIRE_EQUAL(circle.size(), 4);
+    BOOST_CHECK_CLOSE(circle[0].x, 100.0f, 1e-3);
+    BOOST_CHECK_CLOSE(circle[1].z, 100.0f, 1e-3);
+    BOOST_CHECK_CLOSE(circle[2].x, -100.0f, 1e-3);
+    BOOST_CHECK_CLOSE(circle[3].y, 5.0f, 1e-3);
+
+    glrfw::mesh mesh = grid_mesh(60);
+    glrfw::bvh tree(mesh);
+    // poses above the bumpy grid, some of them low enough for the bumps to
+    // hide parts of it
+    std::vector<glm::vec3> sensors;
+    for (const glm::vec3& pose : glrfw::sensor_circle(100.0f, 0.0f, 12)) {
+        sensors.push_back(
+            pose + glm::vec3(0.0f, 0.0f, sensors.size() % 2 ? 10.0f : 300.0f));
+    }
+    glrfw::coverage serial = glrfw::sweep_coverage(tree, mesh, sensors);
+    BOOST_REQUIRE_EQUAL(serial.triangle_counts.size(), mesh.triangles.size());
+    BOOST_REQUIRE_EQUAL(serial.visible_area.size(), sensors.size());
+    // the grid spans two tiles
+    for (unsigned int threads : {0u, 2u, 3u}) {
+        glrfw::coverage parallel =
+            glrfw::sweep_coverage(tree, mesh, sensors, threads);
+        BOOST_CHECK(parallel.triangle_counts == serial.triangle_counts);
+        BOOST_CHECK(parallel.visible_area == serial.visible_area);
+    }
+
+    std::vector<int> counts(mesh.triangles.size(), 0);
+    float total_area = 0.0f;
+    for (std::size_t pose = 0; pose < sensors.size(); ++pose) {
+        double area = 0.0;
+        total_area = 0.0f;
+        for (std::size_t i = 0; i < mesh.triangles.size(); ++i) {
+            const glm::ivec3& tri = mesh.triangles[i];
+            glm::vec3 a = mesh.vertices[tri[0]];
+            glm::vec3 b = mesh.vertices[tri[1]];
+            glm::vec3 c = mesh.vertices[tri[2]];
+            glm::vec3 centroid = (a + b + c) / 3.0f;
+            float tri_area = 0.5f * glm::length(glm::cross(b - a, c - a));
+            total_area += tri_area;
+            glrfw::ray segment(sensors[pose], centroid - sensors[pose], 0.0f,
+                               1.0f - glrfw::visibility_bias);
+            if (!tree.any_hit(segment)) {
+                ++counts[i];
+                area += tri_area;
+            }
+        }
+        BOOST_CHECK_CLOSE(serial.visible_area[pose], area, 1e-3);
+    }
+    BOOST_CHECK(serial.triangle_counts == counts);
+    // the bumps hide part of the grid from every pose
+    for (float area : serial.visible_area) {
+        BOOST_CHECK_GT(area, 0.1f * total_area);
+        BOOST_CHECK_LT(area, 0.99f * total_area);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(depth_rasterizer)
+{
+    // a quad covering the viewport, with and without polygon offset
+    std::vector<glm::vec3> quad{{-1.0f, -1.0f, -0.5f},
+                                {1.0f, -1.0f, 0.5f},
+                                {1.0f, 1.0f, 0.5f},
+                                {-1.0f, 1.0f, -0.5f}};
+    std::vector<glm::ivec3> halves{{0, 1, 2}, {0, 2, 3}};
+    glrfw::depth_rasterizer flat(37, 29);
+    flat.draw(&quad[0], quad.size(), &halves[0], halves.size(),
+              glm::mat4(1.0f));
+    glrfw::depth_rasterizer offset(37, 29);
+    offset.polygon_offset(2.0f, 100.0f);
+    offset.draw(&quad[0], quad.size(), &halves[0], halves.size(),
+                glm::mat4(1.0f));
+    float slope = 0.5f / 37.0f;
+    for (int y = 0; y < 29; ++y) {
+        for (int x = 0; x < 37; ++x) {
+            float expected = 0.25f + slope * (static_cast<float>(x) + 0.5f);
+            BOOST_CHECK_CLOSE(flat.depth(x, y), expected, 1e-3);
+            BOOST_CHECK_CLOSE(offset.depth(x, y) - flat.depth(x, y),
+                              2.0f * slope + 100.0f / 16777216.0f, 1e-1);
+        }
+    }
+
+    // a perspective view of a grid, part of which lies behind the near
+    // plane, against rays through the pixel centers
+    glrfw::mesh mesh = grid_mesh(60);
+    glrfw::bvh tree(mesh);
+    int width = 160;
+    int height = 120;
+    glm::mat4 matrix =
+        glm::perspective(45.0f, 4.0f / 3.0f, 1.0f, 500.0f) *
+        glm::lookAt(glm::vec3(0.3f, -25.7f, 12.1f),
+                    glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 inverse = glm::inverse(matrix);
+    glrfw::depth_rasterizer raster(width, height);
+    raster.draw(mesh, matrix);
+    glrfw::depth_rasterizer parallel(width, height);
+    parallel.draw(mesh, matrix, 0);
+    BOOST_CHECK(parallel.depths() == raster.depths());
+
+    int covered = 0;
+    int mismatched = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec2 ndc(
+                2.0f * (static_cast<float>(x) + 0.5f) / 160.0f - 1.0f,
+                2.0f * (static_cast<float>(y) + 0.5f) / 120.0f - 1.0f);
+            glm::vec4 from = inverse * glm::vec4(ndc, -1.0f, 1.0f);
+            glm::vec4 to = inverse * glm::vec4(ndc, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(from) / from.w;
+            glm::vec3 direction = glm::vec3(to) / to.w - origin;
+            glrfw::ray_hit hit =
+                tree.closest_hit(glrfw::ray(origin, direction, 0.0f, 1.0f));
+            float depth = raster.depth(x, y);
+            if ((hit.triangle == -1) != !(depth < 1.0f)) {
+                ++mismatched;
+                continue;
+            }
+            if (hit.triangle == -1) {
+                continue;
+            }
+            ++covered;
+            glm::vec4 clip =
+                matrix * glm::vec4(origin + hit.t * direction, 1.0f);
+            BOOST_CHECK_SMALL(depth - (clip.z / clip.w + 1.0f) * 0.5f, 1e-5f);
+        }
+    }
+    // only pixel centers close to the silhouette may disagree
+    BOOST_CHECK_GT(covered, width * height / 2);
+    BOOST_CHECK_LT(mismatched, width * height / 200);
+}
+
+BOOST_AUTO_TEST_CASE(pick)
+{
+    glrfw::mesh mesh = grid_mesh(40);
+    BOOST_CHECK(!mesh.has_hierarchy());
+
+    std::vector<glrfw::ray> rays;
+    for (int i = 0; i < 200; ++i) {
+        glm::vec3 target(float((i * 37) % 41) - 20.37f,
+                         float((i * 53) % 43) - 21.71f, 0.0f);
+        glm::vec3 origin(float(i % 13) - 6.13f, float(i % 7) - 3.29f, 40.0f);
+        rays.push_back(glrfw::ray(origin, target - origin));
+    }
+    auto check = [&rays](glrfw::mesh& source) {
+        int hits = 0;
+        for (const glrfw::ray& r : rays) {
+            glrfw::ray_hit expected = brute_force_hit(source, r);
+            glrfw::pick_result picked = source.pick(r);
+            BOOST_REQUIRE_EQUAL(picked.triangle == -1,
+                                expected.triangle == -1);
+            if (picked.triangle == -1) {
+                continue;
+            }
+            ++hits;
+            BOOST_CHECK_CLOSE(picked.t, expected.t, 1e-3);
+            const glm::vec3& b = picked.barycentric;
+            BOOST_CHECK_CLOSE(b.x + b.y + b.z, 1.0f, 1e-3);
+            BOOST_CHECK(b.x >= 0.0f && b.y >= 0.0f && b.z >= 0.0f);
+            glm::vec3 on_ray = r.origin + picked.t * r.direction;
+            BOOST_CHECK_SMALL(glm::length(picked.position - on_ray), 1e-3f);
+        }
+        BOOST_CHECK_GT(hits, 100);
+    };
+    check(mesh);
+    BOOST_CHECK(mesh.has_hierarchy());
+
+    // a tree over raw arrays picks the same, storing only corners and ids
+    glrfw::bvh tree(mesh.vertices.data(), mesh.triangles.data(),
+                    mesh.triangles.size());
+    for (const glrfw::ray& r : rays) {
+        glrfw::pick_result picked =
+            tree.pick(r, mesh.vertices.data(), mesh.triangles.data());
+        BOOST_CHECK_EQUAL(picked.triangle, mesh.pick(r).triangle);
+    }
+    BOOST_CHECK_EQUAL(tree.memory_usage(),
+                      tree.num_nodes() * 32 +
+                          mesh.triangles.size() *
+                              (3 * sizeof(glm::vec3) + sizeof(int)));
+
+    // a moved copy refits its own hierarchy and leaves the original alone
+    glrfw::mesh moved = mesh;
+    for (glm::vec3& vertex : moved.vertices) {
+        vertex.z += 3.0f;
+    }
+    moved.centralize();
+    BOOST_CHECK(moved.hierarchy != mesh.hierarchy);
+    check(moved);
+    check(mesh);
+
+    // new triangles invalidate the hierarchy
+    std::size_t before = mesh.memory_usage();
+    mesh.add_triangle(glm::vec3(-50.0f, -50.0f, 20.0f),
+                      glm::vec3(50.0f, -50.0f, 20.0f),
+                      glm::vec3(0.0f, 50.0f, 20.0f));
+    BOOST_CHECK(!mesh.has_hierarchy());
+    glrfw::pick_result top = mesh.pick(
+        glrfw::ray(glm::vec3(0.0f, 0.0f, 40.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
+    BOOST_CHECK_EQUAL(top.triangle,
+                      static_cast<int>(mesh.triangles.size()) - 1);
+    BOOST_CHECK_CLOSE(top.position.z, 20.0f, 1e-3);
+    BOOST_CHECK_GT(mesh.memory_usage(), before);
+}